@@ -0,0 +1,83 @@
+#include "AliasTable.h"
+
+#include <algorithm>
+
+using namespace dae;
+
+void AliasTable::Build(const std::vector<float>& weights)
+{
+	m_Buckets.clear();
+	m_Probabilities.clear();
+
+	double totalWeight{};
+	for (const float weight : weights)
+	{
+		totalWeight += std::max(weight, 0.f);
+	}
+
+	if (totalWeight <= 0.0)
+		return;
+
+	const uint32_t count{ static_cast<uint32_t>(weights.size()) };
+	m_Buckets.resize(count);
+	m_Probabilities.resize(count);
+
+	//Weights scaled so the average bucket is exactly full, then split into under- and overfull ones
+	std::vector<double> scaledWeights(count);
+	std::vector<uint32_t> small{};
+	std::vector<uint32_t> large{};
+	for (uint32_t i{}; i < count; ++i)
+	{
+		m_Probabilities[i] = static_cast<float>(std::max(weights[i], 0.f) / totalWeight);
+		scaledWeights[i] = std::max(weights[i], 0.f) / totalWeight * count;
+
+		if (scaledWeights[i] < 1.0)
+			small.push_back(i);
+		else
+			large.push_back(i);
+	}
+
+	//Every underfull bucket is topped up by an overfull one, which then may become underfull itself
+	while (!small.empty() && !large.empty())
+	{
+		const uint32_t smallIdx{ small.back() };
+		small.pop_back();
+		const uint32_t largeIdx{ large.back() };
+
+		m_Buckets[smallIdx] = Bucket{ static_cast<float>(scaledWeights[smallIdx]), largeIdx };
+
+		scaledWeights[largeIdx] -= 1.0 - scaledWeights[smallIdx];
+		if (scaledWeights[largeIdx] < 1.0)
+		{
+			large.pop_back();
+			small.push_back(largeIdx);
+		}
+	}
+
+	//Leftovers are full up to rounding
+	for (const uint32_t idx : large)
+	{
+		m_Buckets[idx] = Bucket{ 1.f, idx };
+	}
+	for (const uint32_t idx : small)
+	{
+		m_Buckets[idx] = Bucket{ 1.f, idx };
+	}
+}
+
+int AliasTable::Sample(float random, float& pdf) const
+{
+	pdf = 0.f;
+	if (m_Buckets.empty())
+		return -1;
+
+	//Integer part picks the bucket, the fraction decides between the bucket and its alias
+	const float scaled{ random * m_Buckets.size() };
+	const uint32_t bucketIdx{ std::min(static_cast<uint32_t>(scaled), static_cast<uint32_t>(m_Buckets.size() - 1)) };
+	const Bucket& bucket{ m_Buckets[bucketIdx] };
+
+	const uint32_t index{ scaled - bucketIdx < bucket.threshold ? bucketIdx : bucket.alias };
+
+	pdf = m_Probabilities[index];
+	return pdf > 0.f ? static_cast<int>(index) : -1;
+}
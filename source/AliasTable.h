@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace dae
+{
+	//Walker's alias method: after an O(n) build, an index is drawn proportional to its weight in O(1).
+	//Every bucket holds its own index and one alias, a single random number picks the bucket and the side.
+	class AliasTable final
+	{
+	public:
+		AliasTable() = default;
+		~AliasTable() = default;
+
+		AliasTable(const AliasTable&) = delete;
+		AliasTable(AliasTable&&) noexcept = delete;
+		AliasTable& operator=(const AliasTable&) = delete;
+		AliasTable& operator=(AliasTable&&) noexcept = delete;
+
+		//Negative weights count as zero, an index with weight zero is never drawn
+		void Build(const std::vector<float>& weights);
+		bool IsEmpty() const { return m_Buckets.empty(); }
+
+		//random in [0, 1), returns the drawn index and its probability, or -1 when every weight was zero
+		int Sample(float random, float& pdf) const;
+		float GetProbability(uint32_t index) const { return index < m_Probabilities.size() ? m_Probabilities[index] : 0.f; }
+
+	private:
+		struct Bucket
+		{
+			//Chance of keeping the bucket's own index instead of its alias
+			float threshold{};
+			uint32_t alias{};
+		};
+
+		std::vector<Bucket> m_Buckets{};
+		std::vector<float> m_Probabilities{};
+	};
+}
@@ -0,0 +1,81 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <new>
+
+using namespace dae;
+
+Arena::Arena(size_t blockSize)
+	: m_BlockSize{ std::max(blockSize, m_BlockAlignment) }
+{
+}
+
+Arena::~Arena()
+{
+	for (const Block& block : m_Blocks)
+	{
+		::operator delete(block.pData, std::align_val_t{ m_BlockAlignment });
+	}
+}
+
+void Arena::Rewind(const Marker& marker)
+{
+	if (marker.blockIdx > m_CurrentBlockIdx ||
+		(marker.blockIdx == m_CurrentBlockIdx && marker.offset > m_CurrentOffset))
+		return;
+
+	m_PreviousBlocksBytes = 0;
+	for (size_t blockIdx{}; blockIdx < marker.blockIdx; ++blockIdx)
+	{
+		m_PreviousBlocksBytes += m_Blocks[blockIdx].size;
+	}
+
+	m_CurrentBlockIdx = marker.blockIdx;
+	m_CurrentOffset = marker.offset;
+}
+
+size_t Arena::GetUsedBytes() const
+{
+	return m_PreviousBlocksBytes + m_CurrentOffset;
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment)
+{
+	alignment = std::max<size_t>(alignment, 1);
+
+	//Try the current block, then the following (rewound) ones, then a new one
+	while (m_CurrentBlockIdx < m_Blocks.size())
+	{
+		const Block& block{ m_Blocks[m_CurrentBlockIdx] };
+		const size_t alignedOffset{ (m_CurrentOffset + alignment - 1) & ~(alignment - 1) };
+		if (alignedOffset + bytes <= block.size)
+		{
+			m_CurrentOffset = alignedOffset + bytes;
+			m_PeakUsedBytes = std::max(m_PeakUsedBytes, GetUsedBytes());
+			return block.pData + alignedOffset;
+		}
+
+		if (m_CurrentBlockIdx + 1 == m_Blocks.size())
+			break;
+
+		m_PreviousBlocksBytes += block.size;
+		++m_CurrentBlockIdx;
+		m_CurrentOffset = 0;
+	}
+
+	//Oversized requests get a block of their own size
+	Block block{};
+	block.size = std::max(m_BlockSize, (bytes + m_BlockAlignment - 1) & ~(m_BlockAlignment - 1));
+	block.pData = static_cast<std::byte*>(::operator new(block.size, std::align_val_t{ m_BlockAlignment }));
+	m_ReservedBytes += block.size;
+
+	if (!m_Blocks.empty())
+		m_PreviousBlocksBytes += m_Blocks[m_CurrentBlockIdx].size;
+
+	m_Blocks.push_back(block);
+	m_CurrentBlockIdx = m_Blocks.size() - 1;
+	m_CurrentOffset = bytes;
+	m_PeakUsedBytes = std::max(m_PeakUsedBytes, GetUsedBytes());
+
+	return block.pData;
+}
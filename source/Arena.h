@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+namespace dae
+{
+	//Linear allocator over large aligned blocks. Allocating bumps a pointer, deallocating does nothing,
+	//memory only comes back all at once through Rewind or Reset, which keep the blocks for reuse.
+	//It's a memory_resource, so std::pmr containers can live in it.
+	class Arena final : public std::pmr::memory_resource
+	{
+	public:
+		struct Marker
+		{
+			size_t blockIdx{};
+			size_t offset{};
+		};
+
+		explicit Arena(size_t blockSize = 1 << 20);
+		~Arena() override;
+
+		Arena(const Arena&) = delete;
+		Arena(Arena&&) noexcept = delete;
+		Arena& operator=(const Arena&) = delete;
+		Arena& operator=(Arena&&) noexcept = delete;
+
+		//Uninitialized storage for count trivially destructible objects, nothing ever destroys them
+		template<typename T>
+		T* AllocateArray(size_t count)
+		{
+			static_assert(std::is_trivially_destructible_v<T>, "Arena memory is never destroyed");
+			return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+		}
+
+		//Everything allocated after the marker was taken is given back
+		Marker GetMarker() const { return Marker{ m_CurrentBlockIdx, m_CurrentOffset }; }
+		void Rewind(const Marker& marker);
+		void Reset() { Rewind(Marker{}); }
+
+		size_t GetUsedBytes() const;
+		size_t GetPeakUsedBytes() const { return m_PeakUsedBytes; }
+		size_t GetReservedBytes() const { return m_ReservedBytes; }
+		size_t GetBlockCount() const { return m_Blocks.size(); }
+
+	private:
+		static constexpr size_t m_BlockAlignment{ 64 };
+
+		struct Block
+		{
+			std::byte* pData{};
+			size_t size{};
+		};
+
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void*, size_t, size_t) override {}
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+		size_t m_BlockSize{};
+		std::vector<Block> m_Blocks{};
+		size_t m_CurrentBlockIdx{};
+		size_t m_CurrentOffset{};
+
+		//Bytes in the blocks before the current one, including what alignment and block ends wasted
+		size_t m_PreviousBlocksBytes{};
+		size_t m_PeakUsedBytes{};
+		size_t m_ReservedBytes{};
+	};
+
+	//Gives back everything allocated in the arena during its lifetime, declare it before the containers using it
+	class ArenaScope final
+	{
+	public:
+		explicit ArenaScope(Arena& arena) : m_Arena{ arena }, m_Marker{ arena.GetMarker() } {}
+		~ArenaScope() { m_Arena.Rewind(m_Marker); }
+
+		ArenaScope(const ArenaScope&) = delete;
+		ArenaScope(ArenaScope&&) noexcept = delete;
+		ArenaScope& operator=(const ArenaScope&) = delete;
+		ArenaScope& operator=(ArenaScope&&) noexcept = delete;
+
+	private:
+		Arena& m_Arena;
+		Arena::Marker m_Marker;
+	};
+}
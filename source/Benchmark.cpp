@@ -0,0 +1,282 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+
+using namespace dae;
+
+namespace
+{
+	//Nearest-rank percentile of sorted values
+	float GetPercentile(const std::vector<float>& sortedValues, float percentile)
+	{
+		const size_t rank{ static_cast<size_t>(std::ceil(percentile * sortedValues.size())) };
+		return sortedValues[std::clamp<size_t>(rank, 1, sortedValues.size()) - 1];
+	}
+
+	//Only reads what SaveResult writes, every key is unique in that file
+	bool ReadNumber(const std::string& json, const std::string& key, float& value)
+	{
+		const size_t keyPos{ json.find("\"" + key + "\":") };
+		if (keyPos == std::string::npos)
+			return false;
+
+		const char* pValue{ json.c_str() + keyPos + key.size() + 3 };
+		char* pEnd{};
+		value = std::strtof(pValue, &pEnd);
+		return pEnd != pValue;
+	}
+}
+
+void Benchmark::Start(int numWarmupFrames, int numFrames, bool profileStages)
+{
+	if (m_IsRunning)
+	{
+		std::cout << "(Benchmark already running)\n";
+		return;
+	}
+
+	m_IsRunning = true;
+	m_ProfileStages = profileStages;
+	m_NumWarmupFrames = numWarmupFrames;
+	m_NumFrames = std::max(numFrames, 1);
+	m_CurrentFrame = 0;
+
+	m_FrameTimes.clear();
+	m_FrameTimes.reserve(m_NumFrames);
+	m_TotalTraceTime = 0.0;
+	m_TotalRays = 0;
+	std::fill(std::begin(m_TotalStageTimes), std::end(m_TotalStageTimes), 0.0);
+
+	m_WasProfiling = Profiler::Get().IsEnabled();
+	if (m_ProfileStages)
+		Profiler::Get().SetEnabled(true);
+
+	std::cout << "**BENCHMARK STARTED** " << m_NumWarmupFrames << " warm-up + " << m_NumFrames << " frames\n";
+}
+
+bool Benchmark::AddFrame(float frameTime, const RayStatsFrame& rayStats)
+{
+	if (!m_IsRunning)
+		return false;
+
+	//Warm-up frames fill caches and let the dynamic resolution settle
+	if (m_CurrentFrame++ < m_NumWarmupFrames)
+		return false;
+
+	m_FrameTimes.push_back(frameTime * 1000.f);
+	//Converged frames trace nothing, they only count towards the frame times
+	if (rayStats.GetRayCount() > 0)
+	{
+		m_TotalTraceTime += rayStats.traceTime;
+		m_TotalRays += rayStats.GetRayCount();
+	}
+
+	if (m_ProfileStages)
+	{
+		for (int stage{}; stage < static_cast<int>(ProfileStage::Count); ++stage)
+		{
+			m_TotalStageTimes[stage] += Profiler::Get().GetLastFrameTime(static_cast<ProfileStage>(stage));
+		}
+	}
+
+	if (static_cast<int>(m_FrameTimes.size()) < m_NumFrames)
+		return false;
+
+	Finish();
+	return true;
+}
+
+void Benchmark::Finish()
+{
+	m_IsRunning = false;
+	if (m_ProfileStages)
+		Profiler::Get().SetEnabled(m_WasProfiling);
+
+	BenchmarkResult& result{ m_Result };
+	result = BenchmarkResult{};
+	result.numFrames = static_cast<int>(m_FrameTimes.size());
+	result.numWarmupFrames = m_NumWarmupFrames;
+
+	std::vector<float> sortedTimes{ m_FrameTimes };
+	std::sort(sortedTimes.begin(), sortedTimes.end());
+
+	result.medianFrameTime = GetPercentile(sortedTimes, 0.5f);
+	result.p95FrameTime = GetPercentile(sortedTimes, 0.95f);
+	result.p99FrameTime = GetPercentile(sortedTimes, 0.99f);
+	result.minFrameTime = sortedTimes.front();
+	result.maxFrameTime = sortedTimes.back();
+
+	const double mean{ std::accumulate(sortedTimes.begin(), sortedTimes.end(), 0.0) / sortedTimes.size() };
+	double squaredDeviations{};
+	for (const float time : sortedTimes)
+	{
+		squaredDeviations += (time - mean) * (time - mean);
+	}
+	result.meanFrameTime = static_cast<float>(mean);
+	result.stdDevFrameTime = sortedTimes.size() > 1 ? static_cast<float>(std::sqrt(squaredDeviations / (sortedTimes.size() - 1))) : 0.f;
+
+	//Ray throughput against the time spent tracing, not the presented frame time
+	if (m_TotalRays > 0 && m_TotalTraceTime > 0.0)
+		result.mraysPerSecond = static_cast<float>(m_TotalRays / m_TotalTraceTime / 1'000'000.0);
+
+	result.hasStageTimes = m_ProfileStages;
+	if (m_ProfileStages)
+	{
+		for (int stage{}; stage < static_cast<int>(ProfileStage::Count); ++stage)
+		{
+			result.stageTimes[stage] = static_cast<float>(m_TotalStageTimes[stage] / result.numFrames);
+		}
+	}
+
+	PrintResult();
+}
+
+void Benchmark::PrintResult() const
+{
+	const BenchmarkResult& result{ m_Result };
+
+	std::cout << "**BENCHMARK FINISHED** " << result.numFrames << " frames\n";
+	std::cout << ">> MEDIAN = " << result.medianFrameTime << " ms\n";
+	std::cout << ">> P95 = " << result.p95FrameTime << " ms\n";
+	std::cout << ">> P99 = " << result.p99FrameTime << " ms\n";
+	std::cout << ">> MEAN = " << result.meanFrameTime << " ms (stddev " << result.stdDevFrameTime << " ms)\n";
+	std::cout << ">> MIN/MAX = " << result.minFrameTime << " / " << result.maxFrameTime << " ms\n";
+	if (result.mraysPerSecond >= 0.f)
+		std::cout << ">> MRAYS/S = " << result.mraysPerSecond << "\n";
+
+	if (result.hasStageTimes)
+	{
+		for (int stage{}; stage < static_cast<int>(ProfileStage::Count); ++stage)
+		{
+			std::cout << ">> " << Profiler::GetStageName(static_cast<ProfileStage>(stage)) << " = " << result.stageTimes[stage] << " ms"
+				<< (Profiler::IsPerPixelStage(static_cast<ProfileStage>(stage)) ? " [cpu, all threads]" : "") << "\n";
+		}
+	}
+	std::cout << std::flush;
+}
+
+bool Benchmark::SaveResult(const std::string& filename) const
+{
+	std::ofstream file{ filename };
+	if (!file)
+		return false;
+
+	const BenchmarkResult& result{ m_Result };
+
+	file << "{\n";
+	file << "  \"frames\": " << result.numFrames << ",\n";
+	file << "  \"warmupFrames\": " << result.numWarmupFrames << ",\n";
+	file << "  \"frameTimeMs\": {\n";
+	file << "    \"median\": " << result.medianFrameTime << ",\n";
+	file << "    \"p95\": " << result.p95FrameTime << ",\n";
+	file << "    \"p99\": " << result.p99FrameTime << ",\n";
+	file << "    \"mean\": " << result.meanFrameTime << ",\n";
+	file << "    \"stdDev\": " << result.stdDevFrameTime << ",\n";
+	file << "    \"min\": " << result.minFrameTime << ",\n";
+	file << "    \"max\": " << result.maxFrameTime << "\n";
+	file << "  },\n";
+
+	file << "  \"mraysPerSecond\": ";
+	if (result.mraysPerSecond >= 0.f)
+		file << result.mraysPerSecond;
+	else
+		file << "null";
+
+	if (result.hasStageTimes)
+	{
+		file << ",\n  \"stageTimesMs\": {\n";
+		for (int stage{}; stage < static_cast<int>(ProfileStage::Count); ++stage)
+		{
+			file << "    \"" << Profiler::GetStageName(static_cast<ProfileStage>(stage)) << "\": " << result.stageTimes[stage]
+				<< (stage + 1 < static_cast<int>(ProfileStage::Count) ? ",\n" : "\n");
+		}
+		file << "  }";
+	}
+	file << "\n}\n";
+
+	return true;
+}
+
+bool Benchmark::LoadResult(const std::string& filename, BenchmarkResult& result)
+{
+	std::ifstream file{ filename };
+	if (!file)
+		return false;
+
+	std::stringstream stream{};
+	stream << file.rdbuf();
+	const std::string json{ stream.str() };
+
+	result = BenchmarkResult{};
+
+	float numFrames{};
+	float numWarmupFrames{};
+	if (!ReadNumber(json, "frames", numFrames) || !ReadNumber(json, "warmupFrames", numWarmupFrames) ||
+		!ReadNumber(json, "median", result.medianFrameTime) || !ReadNumber(json, "p95", result.p95FrameTime) ||
+		!ReadNumber(json, "p99", result.p99FrameTime) || !ReadNumber(json, "mean", result.meanFrameTime) ||
+		!ReadNumber(json, "stdDev", result.stdDevFrameTime) || !ReadNumber(json, "min", result.minFrameTime) ||
+		!ReadNumber(json, "max", result.maxFrameTime))
+		return false;
+
+	result.numFrames = static_cast<int>(numFrames);
+	result.numWarmupFrames = static_cast<int>(numWarmupFrames);
+
+	//null fails to parse and leaves the "unknown" default
+	ReadNumber(json, "mraysPerSecond", result.mraysPerSecond);
+
+	result.hasStageTimes = json.find("\"stageTimesMs\"") != std::string::npos;
+	for (int stage{}; result.hasStageTimes && stage < static_cast<int>(ProfileStage::Count); ++stage)
+	{
+		ReadNumber(json, Profiler::GetStageName(static_cast<ProfileStage>(stage)), result.stageTimes[stage]);
+	}
+
+	return true;
+}
+
+bool Benchmark::CompareResults(const BenchmarkResult& baseline, const BenchmarkResult& current, float tolerance)
+{
+	bool hasRegressed{};
+
+	//Lower is better for times, higher is better for throughput
+	const auto compare{ [&](const char* name, float baselineValue, float currentValue, bool isHigherBetter)
+		{
+			if (baselineValue <= 0.f)
+				return;
+
+			const float change{ (currentValue - baselineValue) / baselineValue };
+			//Times also have to grow by a noticeable amount, a few microseconds on a tiny stage are just noise
+			const bool isRegression{ isHigherBetter ? change < -tolerance : change > tolerance && currentValue - baselineValue > m_MinimumTimeRegression };
+			hasRegressed |= isRegression;
+
+			std::cout << (isRegression ? "REGRESSION " : "           ") << name << ": " << baselineValue << " -> " << currentValue
+				<< " (" << (change >= 0.f ? "+" : "") << change * 100.f << "%)\n";
+		} };
+
+	compare("median frame time", baseline.medianFrameTime, current.medianFrameTime, false);
+	compare("p95 frame time", baseline.p95FrameTime, current.p95FrameTime, false);
+	compare("p99 frame time", baseline.p99FrameTime, current.p99FrameTime, false);
+
+	if (baseline.mraysPerSecond >= 0.f && current.mraysPerSecond >= 0.f)
+		compare("Mrays/s", baseline.mraysPerSecond, current.mraysPerSecond, true);
+
+	if (baseline.hasStageTimes && current.hasStageTimes)
+	{
+		for (int stage{}; stage < static_cast<int>(ProfileStage::Count); ++stage)
+		{
+			compare(Profiler::GetStageName(static_cast<ProfileStage>(stage)), baseline.stageTimes[stage], current.stageTimes[stage], false);
+		}
+	}
+
+	//Noise between runs is roughly the spread of the frame times, a change below it proves little
+	if (baseline.medianFrameTime > 0.f && baseline.stdDevFrameTime / baseline.medianFrameTime > tolerance)
+		std::cout << "(Baseline frame times vary by " << baseline.stdDevFrameTime / baseline.medianFrameTime * 100.f << "%, more than the tolerance)\n";
+
+	std::cout << (hasRegressed ? "**REGRESSIONS FOUND**" : "**NO REGRESSIONS**") << std::endl;
+	return hasRegressed;
+}
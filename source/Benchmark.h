@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Profiler.h"
+#include "RayStats.h"
+
+namespace dae
+{
+	//All frame times in milliseconds
+	struct BenchmarkResult
+	{
+		int numFrames{};
+		int numWarmupFrames{};
+
+		float medianFrameTime{};
+		float p95FrameTime{};
+		float p99FrameTime{};
+		float meanFrameTime{};
+		float stdDevFrameTime{};
+		float minFrameTime{};
+		float maxFrameTime{};
+
+		//Negative when the build doesn't count rays (RAY_STATS)
+		float mraysPerSecond{ -1.f };
+
+		bool hasStageTimes{};
+		float stageTimes[static_cast<int>(ProfileStage::Count)]{};
+	};
+
+	//Measures frame times after a warm-up and reports percentiles instead of an FPS average.
+	//Call AddFrame once per presented frame, after Profiler::EndFrame and RayStats::EndFrame.
+	class Benchmark final
+	{
+	public:
+		Benchmark() = default;
+		~Benchmark() = default;
+
+		Benchmark(const Benchmark&) = delete;
+		Benchmark(Benchmark&&) noexcept = delete;
+		Benchmark& operator=(const Benchmark&) = delete;
+		Benchmark& operator=(Benchmark&&) noexcept = delete;
+
+		//Stage times come from the profiler, which adds a little overhead to every pixel
+		void Start(int numWarmupFrames = 30, int numFrames = 200, bool profileStages = true);
+		bool IsRunning() const { return m_IsRunning; }
+
+		//Returns true on the frame that finishes the run
+		bool AddFrame(float frameTime, const RayStatsFrame& rayStats);
+
+		const BenchmarkResult& GetResult() const { return m_Result; }
+		void PrintResult() const;
+
+		bool SaveResult(const std::string& filename) const;
+		static bool LoadResult(const std::string& filename, BenchmarkResult& result);
+
+		//Prints every metric that got worse by more than tolerance (0.05 = 5%), returns true if any did
+		static bool CompareResults(const BenchmarkResult& baseline, const BenchmarkResult& current, float tolerance = 0.05f);
+
+	private:
+		void Finish();
+
+		static constexpr float m_MinimumTimeRegression{ 0.1f };
+
+		bool m_IsRunning{};
+		bool m_ProfileStages{};
+		bool m_WasProfiling{};
+
+		int m_NumWarmupFrames{};
+		int m_NumFrames{};
+		int m_CurrentFrame{};
+
+		std::vector<float> m_FrameTimes{};
+		double m_TotalTraceTime{};
+		uint64_t m_TotalRays{};
+		double m_TotalStageTimes[static_cast<int>(ProfileStage::Count)]{};
+
+		BenchmarkResult m_Result{};
+	};
+}
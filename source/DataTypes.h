@@ -1,7 +1,12 @@
 #pragma once
 #include <cassert>
+#include <climits>
+#include <memory>
+#include <memory_resource>
 
 #include "Math.h"
+#include "MeshCompression.h"
+#include "Profiler.h"
 #include "vector"
 
 //bvh via: https://jacco.ompf2.com/2022/04/13/how-to-build-a-bvh-part-1-basics/
@@ -33,7 +38,7 @@ namespace dae
 		unsigned int leftChild{};
 		unsigned int firstIndex{};
 		unsigned int indexCount{};
-		bool IsLeaf() { return indexCount > 0; };
+		bool IsLeaf() const { return indexCount > 0; };
 	};
 
 	struct AABB
@@ -95,72 +100,82 @@ namespace dae
 		unsigned char materialIndex{};
 	};
 
-	struct TriangleMesh
-	{
-		TriangleMesh() = default;
-		TriangleMesh(const std::vector<Vector3>& _positions, const std::vector<int>& _indices, TriangleCullMode _cullMode) :
-			positions(_positions), indices(_indices), cullMode(_cullMode)
-		{
-			//Calculate Normals
-			CalculateNormals();
-
-			//Update Transforms
-			UpdateTransforms();
-		}
+	class PagedMeshGeometry;
 
-		TriangleMesh(const std::vector<Vector3>& _positions, const std::vector<int>& _indices, const std::vector<Vector3>& _normals, TriangleCullMode _cullMode) :
-			positions(_positions), indices(_indices), normals(_normals), cullMode(_cullMode)
-		{
-			UpdateTransforms();
-		}
-
-
-		~TriangleMesh()
+	//Object-space triangles with their BVH. Filled and built once, then shared read-only by every TriangleMesh placing it
+	struct MeshGeometry
+	{
+		//Every buffer of the geometry, its BVH included, is allocated from pResource
+		explicit MeshGeometry(std::pmr::memory_resource* pResource = std::pmr::get_default_resource()) :
+			positions(pResource), normals(pResource), indices(pResource), bvhNodes(pResource),
+			compactIndices(pResource), octahedralNormals(pResource), quantizedPositions(pResource)
 		{
-			delete[] pBvhNodes;
 		}
 
-		std::vector<Vector3> positions{};
-		std::vector<Vector3> normals{};
-		std::vector<int> indices{};
-		unsigned char materialIndex{};
+		MeshGeometry(const MeshGeometry&) = delete;
+		MeshGeometry(MeshGeometry&&) noexcept = delete;
+		MeshGeometry& operator=(const MeshGeometry&) = delete;
+		MeshGeometry& operator=(MeshGeometry&&) noexcept = delete;
 
-		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
-
-		Matrix rotationTransform{};
-		Matrix translationTransform{};
-		Matrix scaleTransform{};
+		std::pmr::vector<Vector3> positions{};
+		std::pmr::vector<Vector3> normals{};
+		std::pmr::vector<int> indices{};
 
 		Vector3 minAABB;
 		Vector3 maxAABB;
 
-		Vector3 transformedMinAABB;
-		Vector3 transformedMaxAABB;
+		std::pmr::vector<BVHNode> bvhNodes{};
+		unsigned int bvhNodesUsed{};
 
+		//Filled by Compress, each one replaces its full-precision buffer
+		std::pmr::vector<uint16_t> compactIndices{};
+		std::pmr::vector<uint32_t> octahedralNormals{};
+		std::pmr::vector<MeshCompression::QuantizedPosition> quantizedPositions{};
+		Vector3 quantizationStep{};
 
-		BVHNode* pBvhNodes{};
-		unsigned int firstBvhNodeIdx{};
-		unsigned int bvhNodesUsed{};
+		bool hasCompactIndices{};
+		bool hasOctahedralNormals{};
+		bool hasQuantizedPositions{};
 
-		std::vector<Vector3> transformedPositions{};
-		std::vector<Vector3> transformedNormals{};
+		size_t GetIndexCount() const
+		{
+			return hasCompactIndices ? compactIndices.size() : indices.size();
+		}
 
-		void Translate(const Vector3& translation)
+		int GetIndex(size_t i) const
 		{
-			translationTransform = Matrix::CreateTranslation(translation);
+			return hasCompactIndices ? compactIndices[i] : indices[i];
 		}
 
-		void RotateY(float yaw)
+		Vector3 GetPosition(int vertexIdx) const
 		{
-			rotationTransform = Matrix::CreateRotationY(yaw);
+			return hasQuantizedPositions ?
+				MeshCompression::DequantizePosition(quantizedPositions[vertexIdx], minAABB, quantizationStep) :
+				positions[vertexIdx];
 		}
 
-		void Scale(const Vector3& scale)
+		Vector3 GetNormal(size_t triangleIdx) const
 		{
-			scaleTransform = Matrix::CreateScale(scale);
+			return hasOctahedralNormals ? MeshCompression::DecodeOctahedral(octahedralNormals[triangleIdx]) : normals[triangleIdx];
+		}
+
+		//Vertices and normal of the triangle starting at firstIndex, whatever the storage
+		void FetchTriangle(size_t firstIndex, Triangle& triangle) const
+		{
+			triangle.v0 = GetPosition(GetIndex(firstIndex));
+			triangle.v1 = GetPosition(GetIndex(firstIndex + 1));
+			triangle.v2 = GetPosition(GetIndex(firstIndex + 2));
+			triangle.normal = GetNormal(firstIndex / 3);
 		}
 
-		void AppendTriangle(const Triangle& triangle, bool ignoreTransformUpdate = false)
+		size_t GetMemoryBytes() const
+		{
+			return positions.capacity() * sizeof(Vector3) + normals.capacity() * sizeof(Vector3) + indices.capacity() * sizeof(int) +
+				bvhNodes.capacity() * sizeof(BVHNode) + compactIndices.capacity() * sizeof(uint16_t) +
+				octahedralNormals.capacity() * sizeof(uint32_t) + quantizedPositions.capacity() * sizeof(MeshCompression::QuantizedPosition);
+		}
+
+		void AppendTriangle(const Triangle& triangle)
 		{
 			int startIndex = static_cast<int>(positions.size());
 
@@ -173,10 +188,6 @@ namespace dae
 			indices.emplace_back(++startIndex);
 
 			normals.emplace_back(triangle.normal);
-
-			//Not ideal, but making sure all vertices are updated
-			if (!ignoreTransformUpdate)
-				UpdateTransforms();
 		}
 
 		void CalculateNormals()
@@ -189,83 +200,149 @@ namespace dae
 			}
 		}
 
+		//Call once the triangles are in, before the geometry is shared
+		void Build()
+		{
+			PROFILE_SCOPE(ProfileStage::BVHRebuild);
 
-		void UpdateAABB()
+			UpdateAABB();
+#ifdef BVH
+			BuildBVH();
+#endif
+		}
+
+		//Call after Build. Indices go to 16 bits when there are few enough vertices, normals are octahedral encoded and,
+		//with quantizePositions, positions become 16 bits per axis inside the AABB with the BVH refitted around them.
+		//The full-precision buffers go back to the memory resource, an Arena only reuses them after a Reset
+		void Compress(bool quantizePositions)
 		{
-			if (positions.size() > 0)
+			if (!hasCompactIndices && positions.size() <= 65536)
 			{
-				minAABB = positions[0];
-				maxAABB = positions[0];
+				compactIndices.resize(indices.size());
+				for (size_t i{}; i < indices.size(); ++i)
+				{
+					compactIndices[i] = static_cast<uint16_t>(indices[i]);
+				}
+				std::pmr::vector<int>{ indices.get_allocator() }.swap(indices);
+				hasCompactIndices = true;
+			}
 
+			if (!hasOctahedralNormals)
+			{
+				octahedralNormals.resize(normals.size());
+				for (size_t i{}; i < normals.size(); ++i)
+				{
+					octahedralNormals[i] = MeshCompression::EncodeOctahedral(normals[i]);
+				}
+				std::pmr::vector<Vector3>{ normals.get_allocator() }.swap(normals);
+				hasOctahedralNormals = true;
+			}
 
-				for (auto& p : positions)
+			if (quantizePositions && !hasQuantizedPositions)
+			{
+				quantizationStep = (maxAABB - minAABB) / 65535.f;
+
+				quantizedPositions.resize(positions.size());
+				for (size_t i{}; i < positions.size(); ++i)
 				{
-					minAABB = Vector3::Min(p, minAABB);
-					maxAABB = Vector3::Max(p, maxAABB);
+					quantizedPositions[i] = MeshCompression::QuantizePosition(positions[i], minAABB, quantizationStep);
 				}
+				std::pmr::vector<Vector3>{ positions.get_allocator() }.swap(positions);
+				hasQuantizedPositions = true;
+
+				//Rounded vertices can poke out of the node bounds by half a step
+				RefitBVH();
 			}
 		}
 
-		void UpdateTransforms()
+		//Recomputes every node's bounds from the stored vertices, children always come after their parent
+		void RefitBVH()
 		{
-			const Matrix finalTranformation{ scaleTransform * rotationTransform * translationTransform };
-			const Matrix normalTranformation{ rotationTransform * translationTransform };
-
-			transformedPositions.clear();
-			transformedPositions.reserve(positions.size());
-			for (int i{}; i < positions.size(); ++i)
+			for (size_t nodeIdx{ bvhNodes.size() }; nodeIdx-- > 0;)
 			{
-				transformedPositions.emplace_back(finalTranformation.TransformPoint(positions[i]));
+				BVHNode& node{ bvhNodes[nodeIdx] };
+				if (node.IsLeaf())
+				{
+					node.minAABB = Vector3::Unit * FLT_MAX;
+					node.MaxAABB = Vector3::Unit * -FLT_MAX;
+					for (unsigned int i{ node.firstIndex }; i < node.firstIndex + node.indexCount; ++i)
+					{
+						const Vector3 currentVertex{ GetPosition(GetIndex(i)) };
+						node.minAABB = Vector3::Min(node.minAABB, currentVertex);
+						node.MaxAABB = Vector3::Max(node.MaxAABB, currentVertex);
+					}
+				}
+				else
+				{
+					const BVHNode& left{ bvhNodes[node.leftChild] };
+					const BVHNode& right{ bvhNodes[node.leftChild + 1] };
+					node.minAABB = Vector3::Min(left.minAABB, right.minAABB);
+					node.MaxAABB = Vector3::Max(left.MaxAABB, right.MaxAABB);
+				}
 			}
+		}
 
-			transformedNormals.clear();
-			transformedNormals.reserve(normals.size());
-			for (int i{}; i < normals.size(); ++i)
+		void UpdateAABB()
+		{
+			if (positions.size() > 0)
 			{
-				transformedNormals.emplace_back(normalTranformation.TransformVector(normals[i]));
-			}
+				minAABB = positions[0];
+				maxAABB = positions[0];
 
-#ifdef BVH
-			BuildBVH();
-#else
-			UpdateTransformedAABB(finalTranformation);
-#endif
+
+				for (auto& p : positions)
+				{
+					minAABB = Vector3::Min(p, minAABB);
+					maxAABB = Vector3::Max(p, maxAABB);
+				}
+			}
 		}
 
 		void BuildBVH()
 		{
-			if (!pBvhNodes) pBvhNodes = new BVHNode[indices.size()]{};
+			assert(!hasCompactIndices && !hasOctahedralNormals && !hasQuantizedPositions && "Compressed geometry can't be rebuilt");
 
 			bvhNodesUsed = 0;
+			if (indices.empty())
+			{
+				bvhNodes.clear();
+				return;
+			}
+
+			//A BVH over n indices never needs more than n nodes. Built on the heap so the
+			//memory resource only ever holds the nodes actually used
+			std::vector<BVHNode> buildNodes(indices.size());
 
-			BVHNode& root = pBvhNodes[firstBvhNodeIdx];
+			BVHNode& root = buildNodes[0];
 			root.leftChild = 0;
 			root.firstIndex = 0;
 			root.indexCount = static_cast<unsigned int>(indices.size());
 
-			MakeBVHNodeBounds(firstBvhNodeIdx);
+			MakeBVHNodeBounds(buildNodes, 0);
 
-			Subdivide(firstBvhNodeIdx);
+			Subdivide(buildNodes, 0);
+
+			bvhNodes.assign(buildNodes.begin(), buildNodes.begin() + bvhNodesUsed + 1);
 		}
 
-		void MakeBVHNodeBounds(int nodeIdx)
+		void MakeBVHNodeBounds(std::vector<BVHNode>& nodes, int nodeIdx)
 		{
-			BVHNode& node{ pBvhNodes[nodeIdx] };
+			BVHNode& node{ nodes[nodeIdx] };
 
 			node.minAABB = Vector3::Unit * FLT_MAX;
 			node.MaxAABB = Vector3::Unit * FLT_MIN;
 
 			for (unsigned int i{ node.firstIndex }; i < node.firstIndex + node.indexCount; ++i)
 			{
-				Vector3& currentVertex{ transformedPositions[indices[i]] };
+				const Vector3& currentVertex{ positions[indices[i]] };
 				node.minAABB = Vector3::Min(node.minAABB, currentVertex);
 				node.MaxAABB = Vector3::Max(node.MaxAABB, currentVertex);
 			}
 		}
 
-		void Subdivide(int nodeIdx)
+		void Subdivide(std::vector<BVHNode>& nodes, int nodeIdx)
 		{
-			BVHNode& currentNode{ pBvhNodes[nodeIdx] };
+			BVHNode& currentNode{ nodes[nodeIdx] };
 
 			if (currentNode.indexCount <= 5) return;
 
@@ -280,9 +357,9 @@ namespace dae
 			int j{ i + static_cast<int>(currentNode.indexCount) - 1 };
 			while (i <= j)
 			{
-				const Vector3 centroid{ (transformedPositions[indices[i]] +
-					transformedPositions[indices[i + 1]] +
-					transformedPositions[indices[i + 2]]) / 3.0f };
+				const Vector3 centroid{ (positions[indices[i]] +
+					positions[indices[i + 1]] +
+					positions[indices[i + 2]]) / 3.0f };
 
 				if (centroid[axis] < splitPosition)
 				{
@@ -294,7 +371,6 @@ namespace dae
 					std::swap(indices[i + 1], indices[j - 1]);
 					std::swap(indices[i + 2], indices[j]);
 					std::swap(normals[i / 3], normals[(j - 2) / 3]);
-					std::swap(transformedNormals[i / 3], transformedNormals[(j - 2) / 3]);
 
 					j -= 3;
 				}
@@ -311,18 +387,18 @@ namespace dae
 
 			currentNode.leftChild = leftChildIdx;
 
-			pBvhNodes[leftChildIdx].firstIndex = currentNode.firstIndex;
-			pBvhNodes[leftChildIdx].indexCount = leftCount;
-			pBvhNodes[rightChildIdx].firstIndex = i;
-			pBvhNodes[rightChildIdx].indexCount = currentNode.indexCount - leftCount;
+			nodes[leftChildIdx].firstIndex = currentNode.firstIndex;
+			nodes[leftChildIdx].indexCount = leftCount;
+			nodes[rightChildIdx].firstIndex = i;
+			nodes[rightChildIdx].indexCount = currentNode.indexCount - leftCount;
 			currentNode.indexCount = 0;
 
-			MakeBVHNodeBounds(leftChildIdx);
-			MakeBVHNodeBounds(rightChildIdx);
+			MakeBVHNodeBounds(nodes, leftChildIdx);
+			MakeBVHNodeBounds(nodes, rightChildIdx);
 
 
-			Subdivide(leftChildIdx);
-			Subdivide(rightChildIdx);
+			Subdivide(nodes, leftChildIdx);
+			Subdivide(nodes, rightChildIdx);
 		}
 
 		float CalculateBestSplitCost(BVHNode& node, int& axis, float& splitPosition) const
@@ -334,9 +410,9 @@ namespace dae
 				float boundsMax{ FLT_MIN };
 				for (unsigned int i{}; i < node.indexCount; i += 3)
 				{
-					const Vector3 centroid{ (transformedPositions[indices[node.firstIndex + i]] +
-						transformedPositions[indices[node.firstIndex + i + 1]] +
-						transformedPositions[indices[node.firstIndex + i + 2]])
+					const Vector3 centroid{ (positions[indices[node.firstIndex + i]] +
+						positions[indices[node.firstIndex + i + 1]] +
+						positions[indices[node.firstIndex + i + 2]])
 						* 0.3333333f };
 					boundsMin = std::min(centroid[currrentAxis], boundsMin);
 					boundsMax = std::max(centroid[currrentAxis], boundsMax);
@@ -352,9 +428,9 @@ namespace dae
 
 				for (unsigned int i{}; i < node.indexCount; i += 3)
 				{
-					const Vector3& v0{ transformedPositions[indices[node.firstIndex + i]] };
-					const Vector3& v1{ transformedPositions[indices[node.firstIndex + i + 1]] };
-					const Vector3& v2{ transformedPositions[indices[node.firstIndex + i + 2]] };
+					const Vector3& v0{ positions[indices[node.firstIndex + i]] };
+					const Vector3& v1{ positions[indices[node.firstIndex + i + 1]] };
+					const Vector3& v2{ positions[indices[node.firstIndex + i + 2]] };
 
 					const Vector3 centroid{ (v0 + v1 + v2) / 3.0f };
 
@@ -414,9 +490,101 @@ namespace dae
 			const float parentArea{ boxSize.x * boxSize.y + boxSize.y * boxSize.z + boxSize.z * boxSize.x };
 			return node.indexCount * parentArea;
 		}
+	};
+
+	//Placed instance of a MeshGeometry. Only references the geometry, so copies and moves are cheap and safe
+	struct TriangleMesh
+	{
+		TriangleMesh() = default;
+		TriangleMesh(std::shared_ptr<const MeshGeometry> _pGeometry, TriangleCullMode _cullMode, unsigned char _materialIndex) :
+			pGeometry{ std::move(_pGeometry) }, materialIndex{ _materialIndex }, cullMode{ _cullMode }
+		{
+			if (pGeometry)
+			{
+				objectMinAABB = pGeometry->minAABB;
+				objectMaxAABB = pGeometry->maxAABB;
+			}
+			UpdateTransforms();
+		}
+
+		//Out-of-core geometry, the bounds are the ones stored in its file
+		TriangleMesh(std::shared_ptr<const PagedMeshGeometry> _pPagedGeometry, const Vector3& _objectMinAABB, const Vector3& _objectMaxAABB,
+			TriangleCullMode _cullMode, unsigned char _materialIndex) :
+			pPagedGeometry{ std::move(_pPagedGeometry) }, materialIndex{ _materialIndex }, cullMode{ _cullMode },
+			objectMinAABB{ _objectMinAABB }, objectMaxAABB{ _objectMaxAABB }
+		{
+			UpdateTransforms();
+		}
+
+		//One of the two is set, paged geometry is traversed through its page cache
+		std::shared_ptr<const MeshGeometry> pGeometry{};
+		std::shared_ptr<const PagedMeshGeometry> pPagedGeometry{};
+		unsigned char materialIndex{};
+
+		//Optional LOD chain, most detailed first, every level with fewer triangles than the one before.
+		//pGeometry is the level Scene::UpdateLODs picked for this frame. The bounds stay the first level's,
+		//simplified levels lie within them
+		std::vector<std::shared_ptr<const MeshGeometry>> lodGeometries{};
+		unsigned int lodIdx{};
+
+		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
+
+		Matrix rotationTransform{};
+		Matrix translationTransform{};
+		Matrix scaleTransform{};
+
+		//Set by UpdateTransforms, rays are intersected with the geometry in object space
+		Matrix worldTransform{};
+		Matrix inverseWorldTransform{};
+		Matrix normalTransform{};
+
+		Vector3 objectMinAABB;
+		Vector3 objectMaxAABB;
+
+		Vector3 transformedMinAABB;
+		Vector3 transformedMaxAABB;
+
+		void Translate(const Vector3& translation)
+		{
+			translationTransform = Matrix::CreateTranslation(translation);
+		}
+
+		void RotateY(float yaw)
+		{
+			rotationTransform = Matrix::CreateRotationY(yaw);
+		}
+
+		void Scale(const Vector3& scale)
+		{
+			scaleTransform = Matrix::CreateScale(scale);
+		}
+
+		void SelectLOD(unsigned int idx)
+		{
+			lodIdx = idx;
+			pGeometry = lodGeometries[idx];
+		}
+
+		void UpdateTransforms()
+		{
+			worldTransform = scaleTransform * rotationTransform * translationTransform;
+
+			//Each part inverts trivially: negated translation, transposed rotation, reciprocal scale
+			const Vector3 translation{ translationTransform.GetTranslation() };
+			const Matrix inverseScale{ Matrix::CreateScale(1.f / scaleTransform[0][0], 1.f / scaleTransform[1][1], 1.f / scaleTransform[2][2]) };
+			inverseWorldTransform = Matrix::CreateTranslation(-translation) * Matrix::Transpose(rotationTransform) * inverseScale;
+
+			//Inverse transpose of scale * rotation, normals of a non-uniformly scaled mesh lean away from
+			//the stretched axis. Not unit length, hits normalize them
+			normalTransform = inverseScale * rotationTransform;
+
+			UpdateTransformedAABB(worldTransform);
+		}
 
 		void UpdateTransformedAABB(const Matrix& finalTransform)
 		{
+			const Vector3& minAABB{ objectMinAABB };
+			const Vector3& maxAABB{ objectMaxAABB };
 
 			Vector3 tMinAABB = finalTransform.TransformPoint(minAABB);
 			Vector3 tMaxAABB = tMinAABB;
@@ -452,8 +620,13 @@ namespace dae
 			transformedMinAABB = tMinAABB;
 			transformedMaxAABB = tMaxAABB;
 		}
+	};
 
-
+	//Stable reference to a mesh in a Scene. Goes stale, rather than dangling, once that mesh is removed
+	struct MeshHandle
+	{
+		unsigned int index{ UINT_MAX };
+		unsigned int generation{};
 	};
 #pragma endregion
 #pragma region LIGHT
@@ -510,5 +683,22 @@ namespace dae
 		bool didHit{ false };
 		unsigned char materialIndex{ 0 };
 	};
+
+	//Primitive that blocked an earlier shadow ray, tested before the full traversal of the next one
+	struct ShadowOccluder
+	{
+		enum class Type : unsigned char
+		{
+			None,
+			Plane,
+			Sphere,
+			Triangle,
+		};
+
+		Type type{ Type::None };
+		unsigned int geometryIdx{};
+		//Triangle of the mesh at geometryIdx, in triangles not indices
+		unsigned int triangleIdx{};
+	};
 #pragma endregion
 }
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include "GoldenImages.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SDL.h"
+#include "SDL_surface.h"
+
+#include "Renderer.h"
+#include "Scene.h"
+
+using namespace dae;
+
+namespace
+{
+	constexpr int g_Width{ 320 };
+	constexpr int g_Height{ 240 };
+	constexpr int g_NumTimedRenders{ 5 };
+
+	//Root mean square error over all channels in 0-1, allows for compiler and rounding differences
+	constexpr float g_MaxRMSE{ 0.01f };
+	//Past the renderer's 64 sample target, the first frame only records the camera
+	constexpr int g_NumConvergenceFrames{ 70 };
+	//Recorded budgets leave room for run to run noise
+	constexpr float g_BudgetHeadroom{ 1.5f };
+
+	const std::string g_GoldenPath{ "Resources/Golden/" };
+	const std::string g_BudgetsFile{ g_GoldenPath + "budgets.txt" };
+
+	struct GoldenScene
+	{
+		std::string name;
+		std::function<std::unique_ptr<Scene>()> create;
+	};
+
+	//Light sampling mode checked against the exhaustive image once both accumulated
+	struct ConvergenceCheck
+	{
+		std::string name;
+		//Times Renderer::CycleLightSampling is called, starting from exhaustive
+		int numLightSamplingCycles;
+		//What's left is the mode's noise at one light per hit. Tiles that stop refining or biased weights
+		//stay above it, W3 with frozen light tree tiles is at 0.073
+		float maxRMSE;
+	};
+
+	std::map<std::string, float> LoadBudgets()
+	{
+		std::map<std::string, float> budgets{};
+
+		std::ifstream file{ g_BudgetsFile };
+		std::string name{};
+		float budget{};
+		while (file >> name >> budget)
+		{
+			budgets[name] = budget;
+		}
+
+		return budgets;
+	}
+
+	bool SaveBudgets(const std::map<std::string, float>& budgets)
+	{
+		std::ofstream file{ g_BudgetsFile };
+		if (!file)
+			return false;
+
+		file << std::fixed << std::setprecision(2);
+		for (const auto& [name, budget] : budgets)
+		{
+			file << name << ' ' << budget << '\n';
+		}
+
+		return true;
+	}
+
+	//Both surfaces are compared as 8-bit RGB, whatever format the reference was saved in
+	float CalculateRMSE(SDL_Surface* pImage, SDL_Surface* pReference)
+	{
+		SDL_Surface* pConverted{ SDL_ConvertSurfaceFormat(pReference, SDL_PIXELFORMAT_RGB888, 0) };
+		if (!pConverted)
+			return INFINITY;
+
+		double squaredError{};
+		for (int py{}; py < pImage->h; ++py)
+		{
+			const uint32_t* pImageRow{ reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(pImage->pixels) + py * pImage->pitch) };
+			const uint32_t* pReferenceRow{ reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(pConverted->pixels) + py * pConverted->pitch) };
+
+			for (int px{}; px < pImage->w; ++px)
+			{
+				uint8_t imageColor[3]{};
+				uint8_t referenceColor[3]{};
+				SDL_GetRGB(pImageRow[px], pImage->format, &imageColor[0], &imageColor[1], &imageColor[2]);
+				SDL_GetRGB(pReferenceRow[px], pConverted->format, &referenceColor[0], &referenceColor[1], &referenceColor[2]);
+
+				for (int channel{}; channel < 3; ++channel)
+				{
+					const double difference{ (imageColor[channel] - referenceColor[channel]) / 255.0 };
+					squaredError += difference * difference;
+				}
+			}
+		}
+
+		SDL_FreeSurface(pConverted);
+		return static_cast<float>(std::sqrt(squaredError / (3.0 * pImage->w * pImage->h)));
+	}
+
+	//Progressive frames until the image converged, with the light sampling mode cycled numLightSamplingCycles
+	//times from exhaustive. Adaptive sampling stays at its default
+	void RenderConverged(Scene* pScene, SDL_Surface* pImage, int numLightSamplingCycles)
+	{
+		Renderer renderer{ pImage };
+		renderer.SetInteractiveMode(Renderer::InteractiveMode::FullResolution);
+		for (int i{}; i < numLightSamplingCycles; ++i)
+			renderer.CycleLightSampling();
+
+		for (int i{}; i < g_NumConvergenceFrames; ++i)
+			renderer.Render(pScene);
+	}
+}
+
+int dae::RunGoldenImageTests(bool updateReferences)
+{
+	const GoldenScene scenes[]{
+		{ "Scene_W1", [] { return std::make_unique<Scene_W1>(); } },
+		{ "Scene_W2", [] { return std::make_unique<Scene_W2>(); } },
+		{ "Scene_W3", [] { return std::make_unique<Scene_W3>(); } },
+		{ "Scene_W4", [] { return std::make_unique<Scene_W4>(); } },
+		{ "Scene_W4_ReferneceScene", [] { return std::make_unique<Scene_W4_ReferneceScene>(); } },
+		{ "Scene_W4_Bunny", [] { return std::make_unique<Scene_W4_Bunny>(); } },
+		{ "Scene_File_Scaled", [] { return std::make_unique<Scene_File>("Resources/Scenes/Scaled.scene"); } },
+	};
+
+	std::map<std::string, float> budgets{ LoadBudgets() };
+
+	SDL_Surface* pImage{ SDL_CreateRGBSurfaceWithFormat(0, g_Width, g_Height, 32, SDL_PIXELFORMAT_RGB888) };
+	if (!pImage)
+	{
+		std::cout << "Couldn't create the off-screen surface: " << SDL_GetError() << std::endl;
+		return 1;
+	}
+
+	int numFailed{};
+	for (const GoldenScene& goldenScene : scenes)
+	{
+		const std::unique_ptr<Scene> pScene{ goldenScene.create() };
+		pScene->Initialize();
+
+		//One deterministic full resolution frame, nothing that depends on frame time or history
+		Renderer renderer{ pImage };
+		renderer.SetProgressive(false);
+		renderer.SetInteractiveMode(Renderer::InteractiveMode::FullResolution);
+
+		//Best of a few renders, the first also pays for cold caches
+		float renderTime{ INFINITY };
+		for (int i{}; i < g_NumTimedRenders; ++i)
+		{
+			const auto start{ std::chrono::steady_clock::now() };
+			renderer.Render(pScene.get());
+			renderTime = std::min(renderTime, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+
+		const std::string referenceFile{ g_GoldenPath + goldenScene.name + ".bmp" };
+
+		if (updateReferences)
+		{
+			budgets[goldenScene.name] = renderTime * g_BudgetHeadroom;
+			const bool isSaved{ SDL_SaveBMP(pImage, referenceFile.c_str()) == 0 };
+
+			std::cout << std::left << std::setw(28) << goldenScene.name << (isSaved ? "UPDATED " : "FAILED  ")
+				<< renderTime << " ms (budget " << budgets[goldenScene.name] << " ms)" << std::endl;
+			numFailed += !isSaved;
+			continue;
+		}
+
+		SDL_Surface* pReference{ SDL_LoadBMP(referenceFile.c_str()) };
+		if (!pReference || pReference->w != g_Width || pReference->h != g_Height)
+		{
+			std::cout << std::left << std::setw(28) << goldenScene.name << "FAILED  no " << g_Width << "x" << g_Height << " reference at " << referenceFile << std::endl;
+			SDL_FreeSurface(pReference);
+			++numFailed;
+			continue;
+		}
+
+		const float rmse{ CalculateRMSE(pImage, pReference) };
+		SDL_FreeSurface(pReference);
+
+		const auto budgetIt{ budgets.find(goldenScene.name) };
+		const bool hasBudget{ budgetIt != budgets.end() };
+
+		const bool isImageOk{ rmse <= g_MaxRMSE };
+		//A scene without a budget fails too, otherwise a lost budgets.txt would pass every render time
+		const bool isTimeOk{ hasBudget && renderTime <= budgetIt->second };
+
+		std::cout << std::left << std::setw(28) << goldenScene.name << (isImageOk && isTimeOk ? "PASSED  " : "FAILED  ")
+			<< "rmse " << rmse << (isImageOk ? "" : " (over " + std::to_string(g_MaxRMSE) + ")")
+			<< ", " << renderTime << " ms";
+		if (hasBudget)
+			std::cout << (isTimeOk ? " (budget " : " (OVER budget ") << budgetIt->second << " ms)";
+		else
+			std::cout << " (no budget in " << g_BudgetsFile << ")";
+		std::cout << std::endl;
+
+		//Keep the failing image next to the reference for a diff
+		if (!isImageOk)
+			SDL_SaveBMP(pImage, (g_GoldenPath + goldenScene.name + "_failed.bmp").c_str());
+
+		numFailed += !isImageOk || !isTimeOk;
+	}
+
+	//Sampled lighting has to accumulate to the exhaustive image, with adaptive sampling on as it is by
+	//default. Nothing is recorded, the exhaustive render is the reference
+	const ConvergenceCheck convergenceChecks[]{
+		{ "Scene_W3/LightTree", 1, 0.03f },
+		//Power alone ignores how close a light is, W3's two lights are picked about evenly. Averaging out
+		//its 1 / pdf weights, it's at 0.051 and halves with every 4x the light samples
+		{ "Scene_W3/PowerAlias", 2, 0.07f },
+	};
+	if (!updateReferences)
+	{
+		Scene_W3 scene{};
+		scene.Initialize();
+
+		SDL_Surface* pExhaustive{ SDL_CreateRGBSurfaceWithFormat(0, g_Width, g_Height, 32, SDL_PIXELFORMAT_RGB888) };
+		RenderConverged(&scene, pExhaustive, 0);
+
+		for (const ConvergenceCheck& check : convergenceChecks)
+		{
+			RenderConverged(&scene, pImage, check.numLightSamplingCycles);
+			const float rmse{ pExhaustive ? CalculateRMSE(pImage, pExhaustive) : INFINITY };
+			const bool isConverged{ rmse <= check.maxRMSE };
+
+			std::cout << std::left << std::setw(28) << check.name << (isConverged ? "PASSED  " : "FAILED  ")
+				<< "rmse " << rmse << (isConverged ? "" : " (over " + std::to_string(check.maxRMSE) + ")")
+				<< " against exhaustive after " << g_NumConvergenceFrames << " frames" << std::endl;
+			numFailed += !isConverged;
+		}
+
+		SDL_FreeSurface(pExhaustive);
+	}
+
+	SDL_FreeSurface(pImage);
+
+	if (updateReferences && !SaveBudgets(budgets))
+	{
+		std::cout << "Couldn't write " << g_BudgetsFile << std::endl;
+		return 1;
+	}
+
+	std::cout << (numFailed ? "**GOLDEN IMAGES FAILED** " : "**GOLDEN IMAGES PASSED** ") << numFailed << " of "
+		<< std::size(scenes) + (updateReferences ? 0 : std::size(convergenceChecks)) << " failed" << std::endl;
+	return numFailed ? 1 : 0;
+}
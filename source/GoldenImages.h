@@ -0,0 +1,13 @@
+#pragma once
+
+namespace dae
+{
+	//Renders every scene off-screen in its initial state (camera and animation at time zero)
+	//and compares it against Resources/Golden/<scene>.bmp. A scene fails when the image RMSE exceeds
+	//the tolerance or its render time exceeds the budget recorded in Resources/Golden/budgets.txt, or
+	//has none. With updateReferences the images and budgets are rewritten instead. The committed
+	//budgets are twice the slowest times of a noisy single core build, they only catch gross slowdowns:
+	//re-record them to hold a machine to its own times.
+	//Also checks that the sampled light modes converge to the exhaustive image. Returns the process exit code.
+	int RunGoldenImageTests(bool updateReferences);
+}
@@ -0,0 +1,286 @@
+#include "KernelBenchmarks.h"
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "Math.h"
+#include "DataTypes.h"
+#include "Utils.h"
+
+using namespace dae;
+
+namespace
+{
+	constexpr uint32_t g_Seed{ 0x5EED };
+	constexpr int g_NumRays{ 1 << 16 };
+	constexpr double g_MinimumTime{ 0.5 };
+
+	//Keeps the compiler from dropping kernels whose results aren't used
+	volatile uint64_t g_Sink{};
+
+	struct KernelBenchmark
+	{
+		std::string name;
+		//Runs the kernel over all of its items once, returns the number of items processed
+		std::function<uint64_t()> runBatch;
+	};
+
+	//Rays from one viewpoint through a jittered grid covering the mesh, in scanline order like primary rays
+	std::vector<Ray> CreateCoherentRays(const Vector3& minAABB, const Vector3& maxAABB)
+	{
+		const Vector3 center{ (minAABB + maxAABB) * 0.5f };
+		const Vector3 extent{ (maxAABB - minAABB) * 0.5f };
+		const Vector3 origin{ center.x, center.y, center.z - 4.f * extent.Magnitude() };
+
+		const int gridSize{ static_cast<int>(sqrtf(static_cast<float>(g_NumRays))) };
+
+		std::vector<Ray> rays{};
+		rays.reserve(g_NumRays);
+
+		uint32_t seed{ Hash(g_Seed) };
+		for (int y{}; y < gridSize; ++y)
+		{
+			for (int x{}; x < gridSize; ++x)
+			{
+				//Covers a little more than the bounds so some rays miss
+				const float u{ ((x + RandomFloat(seed)) / gridSize * 2.f - 1.f) * 1.2f };
+				const float v{ ((y + RandomFloat(seed)) / gridSize * 2.f - 1.f) * 1.2f };
+				const Vector3 target{ center.x + u * extent.x, center.y + v * extent.y, center.z };
+
+				rays.emplace_back(origin, (target - origin).Normalized());
+			}
+		}
+
+		return rays;
+	}
+
+	//Rays from random points around the mesh towards random points in its bounds, like secondary bounces
+	std::vector<Ray> CreateIncoherentRays(const Vector3& minAABB, const Vector3& maxAABB)
+	{
+		const Vector3 center{ (minAABB + maxAABB) * 0.5f };
+		const Vector3 size{ maxAABB - minAABB };
+		const float radius{ 2.f * size.Magnitude() };
+
+		std::vector<Ray> rays{};
+		rays.reserve(g_NumRays);
+
+		uint32_t seed{ Hash(g_Seed + 1) };
+		for (int i{}; i < g_NumRays; ++i)
+		{
+			Vector3 direction{};
+			do
+			{
+				direction = { RandomFloat(seed) * 2.f - 1.f, RandomFloat(seed) * 2.f - 1.f, RandomFloat(seed) * 2.f - 1.f };
+			} while (direction.SqrMagnitude() > 1.f || direction.SqrMagnitude() < 0.01f);
+
+			const Vector3 origin{ center + direction.Normalized() * radius };
+			const Vector3 target{ minAABB.x + RandomFloat(seed) * size.x, minAABB.y + RandomFloat(seed) * size.y, minAABB.z + RandomFloat(seed) * size.z };
+
+			rays.emplace_back(origin, (target - origin).Normalized());
+		}
+
+		return rays;
+	}
+
+	std::shared_ptr<MeshGeometry> LoadMesh(const std::string& filename)
+	{
+		auto pGeometry{ std::make_shared<MeshGeometry>() };
+		if (!Utils::ParseOBJ(filename, pGeometry->positions, pGeometry->normals, pGeometry->indices))
+			return nullptr;
+
+		pGeometry->Build();
+		return pGeometry;
+	}
+
+	//Runs batches until g_MinimumTime has passed, after one untimed batch to warm the caches
+	void RunBenchmark(const KernelBenchmark& benchmark)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		benchmark.runBatch();
+
+		uint64_t numItems{};
+		uint64_t numBatches{};
+		const Clock::time_point start{ Clock::now() };
+		double elapsed{};
+		do
+		{
+			numItems += benchmark.runBatch();
+			++numBatches;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (elapsed < g_MinimumTime);
+
+		std::cout << std::left << std::setw(48) << benchmark.name << std::right
+			<< std::setw(12) << numItems
+			<< std::setw(12) << std::fixed << std::setprecision(2) << elapsed * 1e9 / numItems << " ns"
+			<< std::setw(12) << std::setprecision(2) << numItems / elapsed / 1e6 << " M/s"
+			<< std::setw(10) << numBatches << std::endl;
+	}
+
+	//Closest hit and any hit (shadow ray) variant of a kernel, over coherent and incoherent rays aimed at the given bounds
+	void AddRayBenchmarks(std::vector<KernelBenchmark>& benchmarks, const std::string& name, const Vector3& minAABB, const Vector3& maxAABB,
+		const std::function<bool(const Ray&, HitRecord&)>& closestHit, const std::function<bool(const Ray&)>& anyHit)
+	{
+		const std::pair<const char*, std::shared_ptr<const std::vector<Ray>>> raySets[]{
+			{ "coherent", std::make_shared<const std::vector<Ray>>(CreateCoherentRays(minAABB, maxAABB)) },
+			{ "incoherent", std::make_shared<const std::vector<Ray>>(CreateIncoherentRays(minAABB, maxAABB)) } };
+		for (const auto& [raySetName, pRays] : raySets)
+		{
+			benchmarks.push_back({ name + "/" + raySetName,
+				[pRays, closestHit]
+				{
+					uint64_t numHits{};
+					for (const Ray& ray : *pRays)
+					{
+						HitRecord hitRecord{};
+						numHits += closestHit(ray, hitRecord);
+					}
+					g_Sink = g_Sink + numHits;
+					return static_cast<uint64_t>(pRays->size());
+				} });
+
+			benchmarks.push_back({ name + "/" + raySetName + "/any",
+				[pRays, anyHit]
+				{
+					uint64_t numHits{};
+					for (const Ray& ray : *pRays)
+					{
+						numHits += anyHit(ray);
+					}
+					g_Sink = g_Sink + numHits;
+					return static_cast<uint64_t>(pRays->size());
+				} });
+		}
+	}
+}
+
+int dae::RunKernelBenchmarks(const std::string& filter)
+{
+#ifdef MOLLERTRUMBORE
+	const std::string trianglePath{ "MollerTrumbore" };
+#else
+	const std::string trianglePath{ "Geometric" };
+#endif // MOLLERTRUMBORE
+
+	std::vector<std::shared_ptr<MeshGeometry>> geometries{};
+	std::vector<TriangleMesh> meshes{};
+	//Same meshes after MeshGeometry::Compress with quantized positions
+	std::vector<TriangleMesh> compressedMeshes{};
+	std::vector<std::string> meshNames{};
+	for (const char* meshName : { "lowpoly_bunny2", "lowpoly_bunny", "simple_object", "simple_cube" })
+	{
+		std::shared_ptr<MeshGeometry> pGeometry{ LoadMesh(std::string{ "Resources/" } + meshName + ".obj") };
+		if (!pGeometry)
+		{
+			std::cout << "Couldn't load Resources/" << meshName << ".obj, run from the source directory" << std::endl;
+			return 1;
+		}
+
+		std::shared_ptr<MeshGeometry> pCompressedGeometry{ LoadMesh(std::string{ "Resources/" } + meshName + ".obj") };
+		pCompressedGeometry->Compress(true);
+
+		meshes.emplace_back(pGeometry, TriangleCullMode::NoCulling, static_cast<unsigned char>(0));
+		compressedMeshes.emplace_back(std::move(pCompressedGeometry), TriangleCullMode::NoCulling, static_cast<unsigned char>(0));
+		geometries.push_back(std::move(pGeometry));
+		meshNames.push_back(meshName);
+	}
+
+	std::vector<KernelBenchmark> benchmarks{};
+
+	//Primitive kernels against the largest mesh's bounds, so hit rates match the mesh benchmarks
+	const MeshGeometry& mainGeometry{ *geometries.front() };
+	const Vector3 minAABB{ meshes.front().transformedMinAABB };
+	const Vector3 maxAABB{ meshes.front().transformedMaxAABB };
+	const Vector3 center{ (minAABB + maxAABB) * 0.5f };
+
+	const Sphere sphere{ center, (maxAABB - minAABB).Magnitude() * 0.4f };
+	AddRayBenchmarks(benchmarks, "HitTest_Sphere", minAABB, maxAABB,
+		[sphere](const Ray& ray, HitRecord& hitRecord) { return GeometryUtils::HitTest_Sphere(sphere, ray, hitRecord); },
+		[sphere](const Ray& ray) { return GeometryUtils::HitTest_Sphere(sphere, ray); });
+
+	const Plane plane{ center, Vector3{ 0.f, 0.f, -1.f } };
+	AddRayBenchmarks(benchmarks, "HitTest_Plane", minAABB, maxAABB,
+		[plane](const Ray& ray, HitRecord& hitRecord) { return GeometryUtils::HitTest_Plane(plane, ray, hitRecord); },
+		[plane](const Ray& ray) { return GeometryUtils::HitTest_Plane(plane, ray); });
+
+	//Every ray against the next triangle of the mesh, over a mesh-sized working set
+	std::vector<Triangle> triangles{};
+	for (size_t i{}; i + 2 < mainGeometry.GetIndexCount(); i += 3)
+	{
+		mainGeometry.FetchTriangle(i, triangles.emplace_back());
+		triangles.back().cullMode = TriangleCullMode::NoCulling;
+	}
+
+	auto pTriangleIdx{ std::make_shared<size_t>() };
+	AddRayBenchmarks(benchmarks, "HitTest_Triangle<" + trianglePath + ">", minAABB, maxAABB,
+		[&triangles, pTriangleIdx](const Ray& ray, HitRecord& hitRecord)
+		{
+			*pTriangleIdx = (*pTriangleIdx + 1) % triangles.size();
+			return GeometryUtils::HitTest_Triangle(triangles[*pTriangleIdx], ray, hitRecord);
+		},
+		[&triangles, pTriangleIdx](const Ray& ray)
+		{
+			*pTriangleIdx = (*pTriangleIdx + 1) % triangles.size();
+			return GeometryUtils::HitTest_Triangle(triangles[*pTriangleIdx], ray);
+		});
+
+	AddRayBenchmarks(benchmarks, "SlabTest_TriangleMesh", minAABB, maxAABB,
+		[minAABB, maxAABB](const Ray& ray, HitRecord&) { return GeometryUtils::SlabTest_TriangleMesh(ray, minAABB, maxAABB); },
+		[minAABB, maxAABB](const Ray& ray) { return GeometryUtils::SlabTest_TriangleMesh(ray, minAABB, maxAABB); });
+
+	//Full mesh traversal, IntersectBVH unless BVH is disabled
+	for (size_t meshIdx{}; meshIdx < meshes.size(); ++meshIdx)
+	{
+		const TriangleMesh& mesh{ meshes[meshIdx] };
+		AddRayBenchmarks(benchmarks, "HitTest_TriangleMesh<" + meshNames[meshIdx] + ">", mesh.transformedMinAABB, mesh.transformedMaxAABB,
+			[&mesh](const Ray& ray, HitRecord& hitRecord) { return GeometryUtils::HitTest_TriangleMesh(mesh, ray, hitRecord); },
+			[&mesh](const Ray& ray) { return GeometryUtils::HitTest_TriangleMesh(mesh, ray); });
+	}
+
+	//Same traversal decoding 16-bit indices and positions and octahedral normals
+	for (size_t meshIdx{}; meshIdx < compressedMeshes.size(); ++meshIdx)
+	{
+		const TriangleMesh& mesh{ compressedMeshes[meshIdx] };
+		AddRayBenchmarks(benchmarks, "HitTest_TriangleMesh<" + meshNames[meshIdx] + "/compressed>", mesh.transformedMinAABB, mesh.transformedMaxAABB,
+			[&mesh](const Ray& ray, HitRecord& hitRecord) { return GeometryUtils::HitTest_TriangleMesh(mesh, ray, hitRecord); },
+			[&mesh](const Ray& ray) { return GeometryUtils::HitTest_TriangleMesh(mesh, ray); });
+	}
+
+	//Rebuilds from an already sorted index buffer, the geometry is otherwise built once at load
+	for (size_t meshIdx{}; meshIdx < geometries.size(); ++meshIdx)
+	{
+		MeshGeometry* pGeometry{ geometries[meshIdx].get() };
+		benchmarks.push_back({ "MeshGeometry::BuildBVH<" + meshNames[meshIdx] + ">",
+			[pGeometry]
+			{
+				pGeometry->BuildBVH();
+				g_Sink = g_Sink + pGeometry->bvhNodesUsed;
+				return static_cast<uint64_t>(1);
+			} });
+	}
+
+	std::cout << std::left << std::setw(48) << "Benchmark" << std::right << std::setw(12) << "Items"
+		<< std::setw(15) << "Time/item" << std::setw(16) << "Throughput" << std::setw(10) << "Batches" << std::endl;
+	std::cout << std::string(101, '-') << std::endl;
+
+	for (const KernelBenchmark& benchmark : benchmarks)
+	{
+		if (benchmark.name.find(filter) != std::string::npos)
+			RunBenchmark(benchmark);
+	}
+
+	return 0;
+}
+
+//Headless build without SDL: compile this file with KERNEL_BENCHMARKS_MAIN defined,
+//together with Matrix.cpp, Vector3.cpp, Vector4.cpp, MeshCompression.cpp, PagedMesh.cpp, Profiler.cpp and RayStats.cpp
+#ifdef KERNEL_BENCHMARKS_MAIN
+int main(int argc, char* args[])
+{
+	return RunKernelBenchmarks(argc >= 2 ? args[1] : "");
+}
+#endif // KERNEL_BENCHMARKS_MAIN
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+namespace dae
+{
+	//Micro-benchmarks for the intersection kernels in GeometryUtils and MeshGeometry::BuildBVH.
+	//Needs no window or SDL, only the math, DataTypes and Utils sources and the meshes in Resources/.
+	//Ray sets are generated from a fixed seed, so every run and every build traces the same rays.
+	//Only benchmarks whose name contains filter are run, returns the process exit code.
+	int RunKernelBenchmarks(const std::string& filter = "");
+}
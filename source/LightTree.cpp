@@ -0,0 +1,268 @@
+#include "LightTree.h"
+
+#include <algorithm>
+
+#include "DataTypes.h"
+
+using namespace dae;
+
+void LightTree::Build(const std::vector<Light>& lights)
+{
+	m_Nodes.clear();
+	m_LightIndices.clear();
+	m_LightPositions.clear();
+	m_LightPowers.clear();
+	m_UnboundedLights.clear();
+
+	for (uint32_t lightIdx{}; lightIdx < lights.size(); ++lightIdx)
+	{
+		const Light& light{ lights[lightIdx] };
+		if (light.type != LightType::Point)
+		{
+			m_UnboundedLights.push_back(lightIdx);
+			continue;
+		}
+
+		m_LightIndices.push_back(lightIdx);
+		m_LightPositions.push_back(light.origin);
+		m_LightPowers.push_back(light.intensity * light.color.GetLuminance());
+	}
+
+	if (m_LightIndices.empty())
+		return;
+
+	//A binary tree over n lights never needs more than 2n - 1 nodes
+	m_Nodes.reserve(2 * m_LightIndices.size() - 1);
+
+	Node root{};
+	root.firstLight = 0;
+	root.lightCount = static_cast<uint32_t>(m_LightIndices.size());
+	m_Nodes.push_back(root);
+
+	UpdateNodeBounds(0);
+	Subdivide(0, 0);
+}
+
+void LightTree::GatherLights(const Vector3& point, const Vector3& normal, float threshold, std::pmr::vector<uint32_t>& lightIndices) const
+{
+	lightIndices.insert(lightIndices.end(), m_UnboundedLights.begin(), m_UnboundedLights.end());
+
+	if (m_Nodes.empty())
+		return;
+
+	uint32_t stack[m_MaxDepth + 1]{};
+	int stackSize{};
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node{ m_Nodes[stack[--stackSize]] };
+
+		if (IsBehindSurface(node, point, normal))
+			continue;
+
+		//Summed power over the closest possible distance, with cos at most 1
+		const float sqrDistance{ GetSqrDistanceToBounds(node, point) };
+		if (sqrDistance > 0.f && node.power / sqrDistance < threshold)
+			continue;
+
+		if (!node.IsLeaf())
+		{
+			stack[stackSize++] = node.leftChild;
+			stack[stackSize++] = node.leftChild + 1;
+			continue;
+		}
+
+		for (uint32_t i{ node.firstLight }; i < node.firstLight + node.lightCount; ++i)
+		{
+			lightIndices.push_back(m_LightIndices[i]);
+		}
+	}
+}
+
+int LightTree::SampleLight(const Vector3& point, const Vector3& normal, float random, float& pdf) const
+{
+	pdf = 0.f;
+	if (m_Nodes.empty())
+		return -1;
+
+	float probability{ 1.f };
+	const Node* pNode{ &m_Nodes[0] };
+
+	while (!pNode->IsLeaf())
+	{
+		const Node& left{ m_Nodes[pNode->leftChild] };
+		const Node& right{ m_Nodes[pNode->leftChild + 1] };
+
+		const float leftImportance{ GetNodeImportance(left, point, normal) };
+		const float rightImportance{ GetNodeImportance(right, point, normal) };
+		if (leftImportance + rightImportance <= 0.f)
+			return -1;
+
+		//The random number is rescaled after every choice, so one number lasts the whole descent
+		const float leftProbability{ leftImportance / (leftImportance + rightImportance) };
+		if (random < leftProbability)
+		{
+			random /= leftProbability;
+			probability *= leftProbability;
+			pNode = &left;
+		}
+		else
+		{
+			random = (random - leftProbability) / (1.f - leftProbability);
+			probability *= 1.f - leftProbability;
+			pNode = &right;
+		}
+		random = std::min(random, 0.99999994f);
+	}
+
+	//Inside a leaf the lights are few enough to weigh exactly
+	float importances[m_MaxLightsPerLeaf]{};
+	float totalImportance{};
+	for (uint32_t i{}; i < pNode->lightCount; ++i)
+	{
+		const uint32_t lightIdx{ pNode->firstLight + i };
+		const Vector3 toLight{ m_LightPositions[lightIdx] - point };
+		const float sqrDistance{ std::max(toLight.SqrMagnitude(), 1e-6f) };
+		const float cosine{ Vector3::Dot(normal, toLight) / sqrtf(sqrDistance) };
+
+		importances[i] = cosine > 0.f ? m_LightPowers[lightIdx] * cosine / sqrDistance : 0.f;
+		totalImportance += importances[i];
+	}
+
+	if (totalImportance <= 0.f)
+		return -1;
+
+	float threshold{ random * totalImportance };
+	for (uint32_t i{}; i < pNode->lightCount; ++i)
+	{
+		if (importances[i] <= 0.f)
+			continue;
+
+		threshold -= importances[i];
+		if (threshold < 0.f || i + 1 == pNode->lightCount)
+		{
+			pdf = probability * importances[i] / totalImportance;
+			return static_cast<int>(m_LightIndices[pNode->firstLight + i]);
+		}
+	}
+
+	//Rounding left the threshold just above zero, take the last light that can contribute
+	for (uint32_t i{ pNode->lightCount }; i-- > 0;)
+	{
+		if (importances[i] > 0.f)
+		{
+			pdf = probability * importances[i] / totalImportance;
+			return static_cast<int>(m_LightIndices[pNode->firstLight + i]);
+		}
+	}
+
+	return -1;
+}
+
+void LightTree::Subdivide(uint32_t nodeIdx, int depth)
+{
+	Node& node{ m_Nodes[nodeIdx] };
+	if (node.lightCount <= m_MaxLightsPerLeaf || depth >= m_MaxDepth - 1)
+		return;
+
+	//Median split along the longest axis keeps the tree balanced for evenly spread street lights
+	const Vector3 extent{ node.maxAABB - node.minAABB };
+	int axis{ 0 };
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	const uint32_t first{ node.firstLight };
+	const uint32_t count{ node.lightCount };
+	const uint32_t middle{ first + count / 2 };
+
+	//Sort light slots by position on the axis, keeping the three arrays in step
+	std::vector<uint32_t> order(count);
+	for (uint32_t i{}; i < count; ++i)
+	{
+		order[i] = first + i;
+	}
+	std::nth_element(order.begin(), order.begin() + count / 2, order.end(),
+		[this, axis](uint32_t a, uint32_t b) { return m_LightPositions[a][axis] < m_LightPositions[b][axis]; });
+
+	std::vector<uint32_t> indices(count);
+	std::vector<Vector3> positions(count);
+	std::vector<float> powers(count);
+	for (uint32_t i{}; i < count; ++i)
+	{
+		indices[i] = m_LightIndices[order[i]];
+		positions[i] = m_LightPositions[order[i]];
+		powers[i] = m_LightPowers[order[i]];
+	}
+	std::copy(indices.begin(), indices.end(), m_LightIndices.begin() + first);
+	std::copy(positions.begin(), positions.end(), m_LightPositions.begin() + first);
+	std::copy(powers.begin(), powers.end(), m_LightPowers.begin() + first);
+
+	const uint32_t leftChildIdx{ static_cast<uint32_t>(m_Nodes.size()) };
+
+	Node left{};
+	left.firstLight = first;
+	left.lightCount = middle - first;
+
+	Node right{};
+	right.firstLight = middle;
+	right.lightCount = first + count - middle;
+
+	//push_back may reallocate, node must not be used after this
+	m_Nodes[nodeIdx].leftChild = leftChildIdx;
+	m_Nodes[nodeIdx].lightCount = 0;
+	m_Nodes.push_back(left);
+	m_Nodes.push_back(right);
+
+	UpdateNodeBounds(leftChildIdx);
+	UpdateNodeBounds(leftChildIdx + 1);
+
+	Subdivide(leftChildIdx, depth + 1);
+	Subdivide(leftChildIdx + 1, depth + 1);
+}
+
+void LightTree::UpdateNodeBounds(uint32_t nodeIdx)
+{
+	Node& node{ m_Nodes[nodeIdx] };
+
+	node.minAABB = m_LightPositions[node.firstLight];
+	node.maxAABB = m_LightPositions[node.firstLight];
+	node.power = 0.f;
+
+	for (uint32_t i{ node.firstLight }; i < node.firstLight + node.lightCount; ++i)
+	{
+		node.minAABB = Vector3::Min(node.minAABB, m_LightPositions[i]);
+		node.maxAABB = Vector3::Max(node.maxAABB, m_LightPositions[i]);
+		node.power += m_LightPowers[i];
+	}
+}
+
+float LightTree::GetNodeImportance(const Node& node, const Vector3& point, const Vector3& normal) const
+{
+	if (IsBehindSurface(node, point, normal))
+		return 0.f;
+
+	//Distance to the center, but never closer than the cluster's own size so nearby clusters don't blow up
+	const Vector3 center{ (node.minAABB + node.maxAABB) * 0.5f };
+	const float sqrRadius{ (node.maxAABB - node.minAABB).SqrMagnitude() * 0.25f };
+	const float sqrDistance{ std::max((center - point).SqrMagnitude(), std::max(sqrRadius, 1e-6f)) };
+
+	return node.power / sqrDistance;
+}
+
+bool LightTree::IsBehindSurface(const Node& node, const Vector3& point, const Vector3& normal)
+{
+	//The corner furthest along the normal decides
+	const Vector3 furthestCorner{
+		normal.x > 0.f ? node.maxAABB.x : node.minAABB.x,
+		normal.y > 0.f ? node.maxAABB.y : node.minAABB.y,
+		normal.z > 0.f ? node.maxAABB.z : node.minAABB.z };
+
+	return Vector3::Dot(normal, furthestCorner - point) <= 0.f;
+}
+
+float LightTree::GetSqrDistanceToBounds(const Node& node, const Vector3& point)
+{
+	const Vector3 closestPoint{ Vector3::Max(node.minAABB, Vector3::Min(point, node.maxAABB)) };
+	return (closestPoint - point).SqrMagnitude();
+}
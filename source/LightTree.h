@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	struct Light;
+
+	//Bounding volume hierarchy over the point lights of a scene. Every node bounds the positions
+	//and the summed power (intensity * luminance) of its lights, which bounds the radiance any of
+	//them can deliver to a point. Other light types are not in the tree.
+	class LightTree final
+	{
+	public:
+		LightTree() = default;
+		~LightTree() = default;
+
+		LightTree(const LightTree&) = delete;
+		LightTree(LightTree&&) noexcept = delete;
+		LightTree& operator=(const LightTree&) = delete;
+		LightTree& operator=(LightTree&&) noexcept = delete;
+
+		void Build(const std::vector<Light>& lights);
+
+		//Appends the index of every point light in front of the surface whose cluster could deliver
+		//at least threshold (radiance luminance * cos) to point, and every unbounded light.
+		//A culled cluster only holds lights that would each have been culled on their own
+		void GatherLights(const Vector3& point, const Vector3& normal, float threshold, std::pmr::vector<uint32_t>& lightIndices) const;
+
+		//Lights that can't be bounded by a position (directional), they always have to be evaluated
+		const std::vector<uint32_t>& GetUnboundedLights() const { return m_UnboundedLights; }
+
+		//Walks down the tree picking children by estimated contribution, random in [0, 1).
+		//Returns the index of the picked light and the probability it had, or -1 when no light faces the point
+		int SampleLight(const Vector3& point, const Vector3& normal, float random, float& pdf) const;
+
+	private:
+		struct Node
+		{
+			Vector3 minAABB{};
+			Vector3 maxAABB{};
+			float power{};
+
+			uint32_t leftChild{};
+			uint32_t firstLight{};
+			uint32_t lightCount{};
+
+			bool IsLeaf() const { return lightCount > 0; }
+		};
+
+		static constexpr uint32_t m_MaxLightsPerLeaf{ 4 };
+		static constexpr int m_MaxDepth{ 64 };
+
+		void Subdivide(uint32_t nodeIdx, int depth);
+		void UpdateNodeBounds(uint32_t nodeIdx);
+
+		float GetNodeImportance(const Node& node, const Vector3& point, const Vector3& normal) const;
+		static bool IsBehindSurface(const Node& node, const Vector3& point, const Vector3& normal);
+		static float GetSqrDistanceToBounds(const Node& node, const Vector3& point);
+
+		std::vector<Node> m_Nodes{};
+
+		//Tree order, m_LightIndices maps back to the scene's lights
+		std::vector<uint32_t> m_LightIndices{};
+		std::vector<Vector3> m_LightPositions{};
+		std::vector<float> m_LightPowers{};
+
+		std::vector<uint32_t> m_UnboundedLights{};
+	};
+}
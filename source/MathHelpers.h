@@ -1,5 +1,7 @@
 #pragma once
 #include <cmath>
+#include <cfloat>
+#include <cstdint>
 
 namespace dae
 {
@@ -29,4 +31,20 @@ namespace dae
 	{
 		return abs(a - b) < epsilon;
 	}
+
+	/* --- RANDOM --- */
+	//PCG hash: stateless, so every thread can derive its own numbers from a pixel/sample index
+	inline uint32_t Hash(uint32_t input)
+	{
+		const uint32_t state{ input * 747796405u + 2891336453u };
+		const uint32_t word{ ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u };
+		return (word >> 22u) ^ word;
+	}
+
+	//Returns a float in [0, 1) and advances the seed
+	inline float RandomFloat(uint32_t& seed)
+	{
+		seed = Hash(seed);
+		return (seed >> 8) * (1.f / 16777216.f);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "MeshCompression.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dae
+{
+	namespace MeshCompression
+	{
+		namespace
+		{
+			int16_t ToSnorm16(float value)
+			{
+				return static_cast<int16_t>(std::lround(std::clamp(value, -1.f, 1.f) * 32767.f));
+			}
+
+			uint16_t ToUnorm16(float value, float minimum, float step)
+			{
+				if (step <= 0.f)
+					return 0;
+
+				return static_cast<uint16_t>(std::clamp(std::lround((value - minimum) / step), 0l, 65535l));
+			}
+		}
+
+		uint32_t EncodeOctahedral(const Vector3& normal)
+		{
+			const float l1Norm{ std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z) };
+			if (l1Norm <= 0.f)
+				return 0;
+
+			float x{ normal.x / l1Norm };
+			float y{ normal.y / l1Norm };
+
+			//Fold the lower hemisphere over the diagonals
+			if (normal.z < 0.f)
+			{
+				const float foldedX{ (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f) };
+				const float foldedY{ (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f) };
+				x = foldedX;
+				y = foldedY;
+			}
+
+			return static_cast<uint16_t>(ToSnorm16(x)) | (static_cast<uint32_t>(static_cast<uint16_t>(ToSnorm16(y))) << 16);
+		}
+
+		QuantizedPosition QuantizePosition(const Vector3& position, const Vector3& minAABB, const Vector3& step)
+		{
+			return QuantizedPosition{
+				ToUnorm16(position.x, minAABB.x, step.x),
+				ToUnorm16(position.y, minAABB.y, step.y),
+				ToUnorm16(position.z, minAABB.z, step.z) };
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "Vector3.h"
+
+namespace dae
+{
+	//Compact vertex formats used by MeshGeometry::Compress. Decoding is inline, it runs inside the intersection loops
+	namespace MeshCompression
+	{
+		//Unit vector folded onto an octahedron, two snorm16 coordinates packed in one word
+		uint32_t EncodeOctahedral(const Vector3& normal);
+
+		inline Vector3 DecodeOctahedral(uint32_t encoded)
+		{
+			Vector3 normal{
+				static_cast<int16_t>(encoded & 0xFFFF) / 32767.f,
+				static_cast<int16_t>(encoded >> 16) / 32767.f,
+				0.f };
+			normal.z = 1.f - std::abs(normal.x) - std::abs(normal.y);
+
+			//Unfold the lower hemisphere
+			const float fold{ std::max(-normal.z, 0.f) };
+			normal.x += normal.x >= 0.f ? -fold : fold;
+			normal.y += normal.y >= 0.f ? -fold : fold;
+
+			return normal.Normalized();
+		}
+
+		//Position as unorm16 per axis between the mesh bounds
+		struct QuantizedPosition
+		{
+			uint16_t x{};
+			uint16_t y{};
+			uint16_t z{};
+		};
+
+		//Step is the size of one unorm16 unit per axis, (max - min) / 65535
+		QuantizedPosition QuantizePosition(const Vector3& position, const Vector3& minAABB, const Vector3& step);
+
+		inline Vector3 DequantizePosition(const QuantizedPosition& position, const Vector3& minAABB, const Vector3& step)
+		{
+			return Vector3{
+				minAABB.x + position.x * step.x,
+				minAABB.y + position.y * step.y,
+				minAABB.z + position.z * step.z };
+		}
+	}
+}
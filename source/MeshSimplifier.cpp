@@ -0,0 +1,425 @@
+#include "MeshSimplifier.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+namespace dae
+{
+	namespace MeshSimplifier
+	{
+		namespace
+		{
+			//Open borders are held by planes through them, this much stronger than the surface itself
+			constexpr double g_BorderWeight{ 1000.0 };
+			//No collapse may turn a remaining triangle further than about 80 degrees
+			constexpr float g_MinNormalCosine{ 0.2f };
+
+			//Squared distance to a set of planes, as the upper triangle of a symmetric 4x4 matrix
+			struct Quadric
+			{
+				double xx{}, xy{}, xz{}, xw{};
+				double yy{}, yz{}, yw{};
+				double zz{}, zw{};
+				double ww{};
+
+				Quadric& operator+=(const Quadric& other)
+				{
+					xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+					yy += other.yy; yz += other.yz; yw += other.yw;
+					zz += other.zz; zw += other.zw;
+					ww += other.ww;
+					return *this;
+				}
+
+				double Evaluate(const Vector3& point) const
+				{
+					const double x{ point.x }, y{ point.y }, z{ point.z };
+					return xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x +
+						yy * y * y + 2 * yz * y * z + 2 * yw * y +
+						zz * z * z + 2 * zw * z +
+						ww;
+				}
+			};
+
+			Quadric MakePlaneQuadric(const Vector3& unitNormal, const Vector3& point, double weight)
+			{
+				const double a{ unitNormal.x }, b{ unitNormal.y }, c{ unitNormal.z };
+				const double d{ -Vector3::Dot(unitNormal, point) };
+				return Quadric{
+					weight * a * a, weight * a * b, weight * a * c, weight * a * d,
+					weight * b * b, weight * b * c, weight * b * d,
+					weight * c * c, weight * c * d,
+					weight * d * d };
+			}
+
+			//Collapses are queued with the versions of their vertices, anything that touched either makes it stale
+			struct Collapse
+			{
+				double cost{};
+				uint32_t v0{};
+				uint32_t v1{};
+				uint32_t version0{};
+				uint32_t version1{};
+				Vector3 position{};
+
+				bool operator>(const Collapse& other) const { return cost > other.cost; }
+			};
+
+			uint64_t GetEdgeKey(uint32_t a, uint32_t b)
+			{
+				return a < b ? (uint64_t{ a } << 32) | b : (uint64_t{ b } << 32) | a;
+			}
+
+			class Simplifier final
+			{
+			public:
+				Simplifier(const std::vector<Vector3>& positions, const std::vector<int>& indices) :
+					m_Positions{ positions },
+					m_VertexTriangles(positions.size()),
+					m_Quadrics(positions.size()),
+					m_Versions(positions.size()),
+					m_IsVertexRemoved(positions.size())
+				{
+					//Triangles pointing outside the vertices or repeating one are left out
+					for (size_t i{}; i + 2 < indices.size(); i += 3)
+					{
+						const int i0{ indices[i] }, i1{ indices[i + 1] }, i2{ indices[i + 2] };
+						const int numVertices{ static_cast<int>(positions.size()) };
+						if (i0 < 0 || i1 < 0 || i2 < 0 || i0 >= numVertices || i1 >= numVertices || i2 >= numVertices ||
+							i0 == i1 || i1 == i2 || i2 == i0)
+							continue;
+
+						const uint32_t triangleIdx{ static_cast<uint32_t>(m_Indices.size() / 3) };
+						for (const int index : { i0, i1, i2 })
+						{
+							m_Indices.push_back(static_cast<uint32_t>(index));
+							m_VertexTriangles[index].push_back(triangleIdx);
+						}
+					}
+
+					m_NumTriangles = m_Indices.size() / 3;
+					m_IsTriangleRemoved.resize(m_NumTriangles);
+
+					//Each face's plane goes to its corners, weighted by area so slivers count for little
+					std::unordered_map<uint64_t, uint32_t> edgeTriangleCounts{};
+					for (uint32_t triangleIdx{}; triangleIdx < m_NumTriangles; ++triangleIdx)
+					{
+						const uint32_t* pCorners{ &m_Indices[triangleIdx * 3] };
+						const Vector3 normal{ GetTriangleNormal(triangleIdx) };
+						const float doubleArea{ normal.Magnitude() };
+						if (doubleArea > 0.f)
+						{
+							const Quadric quadric{ MakePlaneQuadric(normal / doubleArea, m_Positions[pCorners[0]], doubleArea * 0.5) };
+							for (int corner{}; corner < 3; ++corner)
+								m_Quadrics[pCorners[corner]] += quadric;
+						}
+
+						for (int corner{}; corner < 3; ++corner)
+							++edgeTriangleCounts[GetEdgeKey(pCorners[corner], pCorners[(corner + 1) % 3])];
+					}
+
+					//A border edge gets a plane through it, perpendicular to its face, so the border can't shrink
+					for (uint32_t triangleIdx{}; triangleIdx < m_NumTriangles; ++triangleIdx)
+					{
+						const uint32_t* pCorners{ &m_Indices[triangleIdx * 3] };
+						const Vector3 normal{ GetTriangleNormal(triangleIdx).Normalized() };
+						for (int corner{}; corner < 3; ++corner)
+						{
+							const uint32_t a{ pCorners[corner] }, b{ pCorners[(corner + 1) % 3] };
+							if (edgeTriangleCounts[GetEdgeKey(a, b)] != 1)
+								continue;
+
+							const Vector3 edge{ m_Positions[b] - m_Positions[a] };
+							const Vector3 borderNormal{ Vector3::Cross(edge, normal) };
+							const float length{ borderNormal.Magnitude() };
+							if (length <= 0.f)
+								continue;
+
+							const Quadric quadric{ MakePlaneQuadric(borderNormal / length, m_Positions[a], g_BorderWeight * edge.SqrMagnitude()) };
+							m_Quadrics[a] += quadric;
+							m_Quadrics[b] += quadric;
+						}
+					}
+
+					for (const auto& [edgeKey, count] : edgeTriangleCounts)
+						PushCollapse(static_cast<uint32_t>(edgeKey >> 32), static_cast<uint32_t>(edgeKey));
+				}
+
+				Simplifier(const Simplifier&) = delete;
+				Simplifier(Simplifier&&) noexcept = delete;
+				Simplifier& operator=(const Simplifier&) = delete;
+				Simplifier& operator=(Simplifier&&) noexcept = delete;
+
+				size_t Run(size_t targetTriangles)
+				{
+					while (m_NumTriangles > targetTriangles && !m_Collapses.empty())
+					{
+						const Collapse collapse{ m_Collapses.top() };
+						m_Collapses.pop();
+
+						if (m_IsVertexRemoved[collapse.v0] || m_IsVertexRemoved[collapse.v1] ||
+							m_Versions[collapse.v0] != collapse.version0 || m_Versions[collapse.v1] != collapse.version1)
+							continue;
+
+						if (IsCollapseValid(collapse.v0, collapse.v1, collapse.position))
+							ApplyCollapse(collapse.v0, collapse.v1, collapse.position);
+					}
+
+					return m_NumTriangles;
+				}
+
+				//Only the vertices still used, renumbered in their original order
+				void Output(std::vector<Vector3>& positions, std::vector<int>& indices) const
+				{
+					positions.clear();
+					indices.clear();
+
+					std::vector<int> remap(m_Positions.size(), -1);
+					for (size_t triangleIdx{}; triangleIdx < m_IsTriangleRemoved.size(); ++triangleIdx)
+					{
+						if (m_IsTriangleRemoved[triangleIdx])
+							continue;
+
+						for (int corner{}; corner < 3; ++corner)
+						{
+							const uint32_t vertexIdx{ m_Indices[triangleIdx * 3 + corner] };
+							if (remap[vertexIdx] < 0)
+							{
+								remap[vertexIdx] = static_cast<int>(positions.size());
+								positions.push_back(m_Positions[vertexIdx]);
+							}
+							indices.push_back(remap[vertexIdx]);
+						}
+					}
+				}
+
+			private:
+				std::vector<Vector3> m_Positions;
+				//Three per triangle, collapsed vertices are renamed in place
+				std::vector<uint32_t> m_Indices{};
+				std::vector<bool> m_IsTriangleRemoved{};
+				size_t m_NumTriangles{};
+
+				std::vector<std::vector<uint32_t>> m_VertexTriangles;
+				std::vector<Quadric> m_Quadrics;
+				std::vector<uint32_t> m_Versions;
+				std::vector<bool> m_IsVertexRemoved;
+
+				std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_Collapses{};
+
+				//Scratch for the neighbourhood checks
+				std::vector<uint32_t> m_Neighbors0{};
+				std::vector<uint32_t> m_Neighbors1{};
+
+				Vector3 GetTriangleNormal(size_t triangleIdx) const
+				{
+					const uint32_t* pCorners{ &m_Indices[triangleIdx * 3] };
+					const Vector3& p0{ m_Positions[pCorners[0]] };
+					return Vector3::Cross(m_Positions[pCorners[1]] - p0, m_Positions[pCorners[2]] - p0);
+				}
+
+				bool HasVertex(uint32_t triangleIdx, uint32_t vertexIdx) const
+				{
+					const uint32_t* pCorners{ &m_Indices[triangleIdx * 3] };
+					return pCorners[0] == vertexIdx || pCorners[1] == vertexIdx || pCorners[2] == vertexIdx;
+				}
+
+				void GatherNeighbors(uint32_t vertexIdx, std::vector<uint32_t>& neighbors) const
+				{
+					neighbors.clear();
+					for (const uint32_t triangleIdx : m_VertexTriangles[vertexIdx])
+					{
+						if (m_IsTriangleRemoved[triangleIdx])
+							continue;
+
+						for (int corner{}; corner < 3; ++corner)
+						{
+							const uint32_t neighborIdx{ m_Indices[triangleIdx * 3 + corner] };
+							if (neighborIdx != vertexIdx)
+								neighbors.push_back(neighborIdx);
+						}
+					}
+
+					std::sort(neighbors.begin(), neighbors.end());
+					neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+				}
+
+				//Cheapest of the endpoints and the midpoint
+				void PushCollapse(uint32_t v0, uint32_t v1)
+				{
+					Quadric quadric{ m_Quadrics[v0] };
+					quadric += m_Quadrics[v1];
+
+					Collapse collapse{ std::numeric_limits<double>::max(), v0, v1, m_Versions[v0], m_Versions[v1] };
+					for (const Vector3& position : { m_Positions[v0], m_Positions[v1], (m_Positions[v0] + m_Positions[v1]) * 0.5f })
+					{
+						const double cost{ quadric.Evaluate(position) };
+						if (cost < collapse.cost)
+						{
+							collapse.cost = cost;
+							collapse.position = position;
+						}
+					}
+
+					m_Collapses.push(collapse);
+				}
+
+				bool IsCollapseValid(uint32_t v0, uint32_t v1, const Vector3& position)
+				{
+					//Link condition: the edge's own triangles must be the only ones the two vertices share,
+					//otherwise the collapse pinches the surface into a non-manifold fold
+					GatherNeighbors(v0, m_Neighbors0);
+					GatherNeighbors(v1, m_Neighbors1);
+
+					size_t numSharedNeighbors{};
+					for (const uint32_t neighborIdx : m_Neighbors0)
+						numSharedNeighbors += std::binary_search(m_Neighbors1.begin(), m_Neighbors1.end(), neighborIdx);
+
+					size_t numEdgeTriangles{};
+					for (const uint32_t triangleIdx : m_VertexTriangles[v0])
+						numEdgeTriangles += !m_IsTriangleRemoved[triangleIdx] && HasVertex(triangleIdx, v1);
+
+					if (numEdgeTriangles == 0 || numSharedNeighbors != numEdgeTriangles)
+						return false;
+
+					//The triangles that stay may not flip or turn too far
+					for (const uint32_t movedIdx : { v0, v1 })
+					{
+						for (const uint32_t triangleIdx : m_VertexTriangles[movedIdx])
+						{
+							if (m_IsTriangleRemoved[triangleIdx] || (HasVertex(triangleIdx, v0) && HasVertex(triangleIdx, v1)))
+								continue;
+
+							const Vector3 oldNormal{ GetTriangleNormal(triangleIdx) };
+							const float oldLength{ oldNormal.Magnitude() };
+							if (oldLength <= 0.f)
+								continue;
+
+							Vector3 corners[3]{};
+							for (int corner{}; corner < 3; ++corner)
+							{
+								const uint32_t vertexIdx{ m_Indices[triangleIdx * 3 + corner] };
+								corners[corner] = vertexIdx == movedIdx ? position : m_Positions[vertexIdx];
+							}
+
+							const Vector3 newNormal{ Vector3::Cross(corners[1] - corners[0], corners[2] - corners[0]) };
+							if (Vector3::Dot(oldNormal, newNormal) <= g_MinNormalCosine * oldLength * newNormal.Magnitude())
+								return false;
+						}
+					}
+
+					return true;
+				}
+
+				//v1 goes into v0, the triangles on the edge go away
+				void ApplyCollapse(uint32_t v0, uint32_t v1, const Vector3& position)
+				{
+					for (const uint32_t triangleIdx : m_VertexTriangles[v1])
+					{
+						if (m_IsTriangleRemoved[triangleIdx])
+							continue;
+
+						if (HasVertex(triangleIdx, v0))
+						{
+							m_IsTriangleRemoved[triangleIdx] = true;
+							--m_NumTriangles;
+							continue;
+						}
+
+						uint32_t* pCorners{ &m_Indices[triangleIdx * 3] };
+						std::replace(pCorners, pCorners + 3, v1, v0);
+						m_VertexTriangles[v0].push_back(triangleIdx);
+					}
+					m_VertexTriangles[v1].clear();
+
+					std::vector<uint32_t>& triangles{ m_VertexTriangles[v0] };
+					triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+						[this](uint32_t triangleIdx) { return m_IsTriangleRemoved[triangleIdx]; }), triangles.end());
+
+					m_Positions[v0] = position;
+					m_Quadrics[v0] += m_Quadrics[v1];
+					m_IsVertexRemoved[v1] = true;
+					++m_Versions[v0];
+					++m_Versions[v1];
+
+					GatherNeighbors(v0, m_Neighbors0);
+					for (const uint32_t neighborIdx : m_Neighbors0)
+						PushCollapse(v0, neighborIdx);
+				}
+			};
+
+			bool WriteOBJ(const std::string& filename, const std::vector<Vector3>& positions, const std::vector<int>& indices)
+			{
+				std::ofstream file{ filename };
+				if (!file)
+					return false;
+
+				file << std::setprecision(std::numeric_limits<float>::max_digits10);
+				file << "# " << indices.size() / 3 << " triangles, written by RayTracer --build-lods\n";
+				for (const Vector3& position : positions)
+					file << "v " << position.x << ' ' << position.y << ' ' << position.z << '\n';
+				for (size_t i{}; i + 2 < indices.size(); i += 3)
+					file << "f " << indices[i] + 1 << ' ' << indices[i + 1] + 1 << ' ' << indices[i + 2] + 1 << '\n';
+
+				return static_cast<bool>(file);
+			}
+		}
+
+		size_t Simplify(const std::vector<Vector3>& positions, const std::vector<int>& indices, size_t targetTriangles,
+			std::vector<Vector3>& simplifiedPositions, std::vector<int>& simplifiedIndices)
+		{
+			Simplifier simplifier{ positions, indices };
+			const size_t numTriangles{ simplifier.Run(targetTriangles) };
+			simplifier.Output(simplifiedPositions, simplifiedIndices);
+			return numTriangles;
+		}
+
+		int BuildLODs(const std::string& objFilename, int numLevels)
+		{
+			std::vector<Vector3> positions{};
+			std::vector<Vector3> normals{};
+			std::vector<int> indices{};
+			if (!Utils::ParseOBJ(objFilename, positions, normals, indices))
+			{
+				std::cout << "Couldn't read " << objFilename << std::endl;
+				return 1;
+			}
+
+			const std::string stem{ objFilename.substr(0, objFilename.rfind(".obj")) };
+
+			//Every level starts from the full mesh, so errors of the coarser levels don't pile up
+			size_t previousTriangles{ indices.size() / 3 };
+			std::vector<Vector3> lodPositions{};
+			std::vector<int> lodIndices{};
+			for (int level{ 1 }; level <= numLevels; ++level)
+			{
+				const size_t numTriangles{ Simplify(positions, indices, previousTriangles / 2, lodPositions, lodIndices) };
+				if (numTriangles >= previousTriangles)
+				{
+					std::cout << objFilename << " can't be simplified past " << previousTriangles << " triangles" << std::endl;
+					break;
+				}
+
+				const std::string lodFilename{ stem + "_lod" + std::to_string(level) + ".obj" };
+				if (!WriteOBJ(lodFilename, lodPositions, lodIndices))
+				{
+					std::cout << "Couldn't write " << lodFilename << std::endl;
+					return 1;
+				}
+
+				std::cout << "LOD " << level << ": " << numTriangles << " triangles in " << lodFilename << std::endl;
+				previousTriangles = numTriangles;
+			}
+
+			return 0;
+		}
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Vector3.h"
+
+namespace dae
+{
+	//Offline mesh simplification for LOD chains: quadric error edge collapses (Garland & Heckbert) that keep
+	//vertices on an edge's endpoints or midpoint, so a LOD never leaves the bounds of the mesh it came from
+	namespace MeshSimplifier
+	{
+		//Collapses edges until at most targetTriangles remain or no collapse is left that doesn't fold the
+		//surface over. Open borders are kept in place. Returns the triangle count reached
+		size_t Simplify(const std::vector<Vector3>& positions, const std::vector<int>& indices, size_t targetTriangles,
+			std::vector<Vector3>& simplifiedPositions, std::vector<int>& simplifiedIndices);
+
+		//Writes <name>_lod1.obj up to <name>_lod<numLevels>.obj next to the .obj, each with half the triangles
+		//of the one before, for RayTracer --build-lods. Returns the process exit code
+		int BuildLODs(const std::string& objFilename, int numLevels);
+	}
+}
@@ -0,0 +1,564 @@
+#include "PagedMesh.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace dae;
+
+//File layout, every offset a multiple of the page size so pages map on their own:
+//	page 0				FileHeader
+//	page 1..numPages	PageHeader, BVHNode[numNodes], PagedTriangle[numTriangles], padding
+//	after the pages		PagedMeshNode[numTopNodes], the top tree with its root first
+
+namespace
+{
+	constexpr char g_Magic[8]{ 'D', 'A', 'E', 'P', 'M', 'S', 'H', '\0' };
+	constexpr uint32_t g_Version{ 1 };
+	constexpr uint32_t g_MappingGranularity{ 1 << 16 };
+
+	struct FileHeader
+	{
+		char magic[8]{};
+		uint32_t version{};
+		uint32_t pageSize{};
+		uint32_t numPages{};
+		uint32_t numTopNodes{};
+		uint32_t maxTrianglesPerPage{};
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+	};
+
+	struct PageHeader
+	{
+		uint32_t numNodes{};
+		uint32_t numTriangles{};
+	};
+
+	//Everything is written as it is in memory, these have no padding to leak into the file
+	static_assert(sizeof(BVHNode) == 36 && sizeof(PagedTriangle) == 48 && sizeof(PagedMeshNode) == 40);
+
+	size_t GetPageBytes(size_t numNodes, size_t numTriangles)
+	{
+		return sizeof(PageHeader) + numNodes * sizeof(BVHNode) + numTriangles * sizeof(PagedTriangle);
+	}
+
+	//Greedily packs BVH subtrees into pages in depth-first order, so neighbouring subtrees share a page
+	class PageWriter final
+	{
+	public:
+		PageWriter(const MeshGeometry& geometry, std::ofstream& file, uint32_t pageSize) :
+			m_Geometry{ geometry }, m_File{ file }, m_PageSize{ pageSize },
+			m_SubtreeNodes(geometry.bvhNodes.size()), m_SubtreeTriangles(geometry.bvhNodes.size())
+		{
+			CountSubtree(0);
+		}
+
+		PageWriter(const PageWriter&) = delete;
+		PageWriter(PageWriter&&) noexcept = delete;
+		PageWriter& operator=(const PageWriter&) = delete;
+		PageWriter& operator=(PageWriter&&) noexcept = delete;
+
+		const std::vector<PagedMeshNode>& GetTopNodes() const { return m_TopNodes; }
+		uint32_t GetPageCount() const { return m_NumPages; }
+
+		//Returns the index of the top node standing for the subtree, always pushed before its children
+		uint32_t WriteSubtree(uint32_t nodeIdx)
+		{
+			const BVHNode& node{ m_Geometry.bvhNodes[nodeIdx] };
+
+			if (GetPageBytes(m_SubtreeNodes[nodeIdx], m_SubtreeTriangles[nodeIdx]) <= m_PageSize)
+			{
+				ReservePage(m_SubtreeNodes[nodeIdx], m_SubtreeTriangles[nodeIdx]);
+
+				PagedMeshNode& topNode{ m_TopNodes.emplace_back() };
+				topNode.minAABB = node.minAABB;
+				topNode.MaxAABB = node.MaxAABB;
+				topNode.pageIdx = m_NumPages;
+				topNode.pageNodeIdx = CopySubtree(nodeIdx);
+				return static_cast<uint32_t>(m_TopNodes.size() - 1);
+			}
+
+			if (node.IsLeaf())
+				return WriteTriangleRange(node.firstIndex, node.indexCount);
+
+			const uint32_t topIdx{ static_cast<uint32_t>(m_TopNodes.size()) };
+			m_TopNodes.push_back(PagedMeshNode{ node.minAABB, node.MaxAABB });
+
+			const uint32_t leftIdx{ WriteSubtree(node.leftChild) };
+			const uint32_t rightIdx{ WriteSubtree(node.leftChild + 1) };
+			m_TopNodes[topIdx].leftChild = leftIdx;
+			m_TopNodes[topIdx].rightChild = rightIdx;
+			return topIdx;
+		}
+
+		void Flush()
+		{
+			if (m_PageNodes.empty())
+				return;
+
+			const PageHeader header{ static_cast<uint32_t>(m_PageNodes.size()), static_cast<uint32_t>(m_PageTriangles.size()) };
+			m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			m_File.write(reinterpret_cast<const char*>(m_PageNodes.data()), m_PageNodes.size() * sizeof(BVHNode));
+			m_File.write(reinterpret_cast<const char*>(m_PageTriangles.data()), m_PageTriangles.size() * sizeof(PagedTriangle));
+
+			const std::vector<char> padding(m_PageSize - GetPageBytes(m_PageNodes.size(), m_PageTriangles.size()));
+			m_File.write(padding.data(), padding.size());
+
+			m_PageNodes.clear();
+			m_PageTriangles.clear();
+			++m_NumPages;
+		}
+
+	private:
+		const MeshGeometry& m_Geometry;
+		std::ofstream& m_File;
+		const uint32_t m_PageSize;
+
+		std::vector<size_t> m_SubtreeNodes;
+		std::vector<size_t> m_SubtreeTriangles;
+
+		std::vector<PagedMeshNode> m_TopNodes{};
+		uint32_t m_NumPages{};
+
+		//Contents of the page being filled
+		std::vector<BVHNode> m_PageNodes{};
+		std::vector<PagedTriangle> m_PageTriangles{};
+
+		void CountSubtree(uint32_t nodeIdx)
+		{
+			const BVHNode& node{ m_Geometry.bvhNodes[nodeIdx] };
+			if (node.IsLeaf())
+			{
+				m_SubtreeNodes[nodeIdx] = 1;
+				m_SubtreeTriangles[nodeIdx] = node.indexCount / 3;
+				return;
+			}
+
+			CountSubtree(node.leftChild);
+			CountSubtree(node.leftChild + 1);
+			m_SubtreeNodes[nodeIdx] = 1 + m_SubtreeNodes[node.leftChild] + m_SubtreeNodes[node.leftChild + 1];
+			m_SubtreeTriangles[nodeIdx] = m_SubtreeTriangles[node.leftChild] + m_SubtreeTriangles[node.leftChild + 1];
+		}
+
+		void ReservePage(size_t numNodes, size_t numTriangles)
+		{
+			if (GetPageBytes(m_PageNodes.size() + numNodes, m_PageTriangles.size() + numTriangles) > m_PageSize)
+				Flush();
+		}
+
+		void AppendTriangles(uint32_t firstIndex, uint32_t indexCount)
+		{
+			Triangle triangle{};
+			for (uint32_t i{}; i < indexCount; i += 3)
+			{
+				m_Geometry.FetchTriangle(firstIndex + i, triangle);
+				m_PageTriangles.push_back(PagedTriangle{ triangle.v0, triangle.v1, triangle.v2, triangle.normal });
+			}
+		}
+
+		//Copies the subtree into the open page, children stay in adjacent pairs after their parent
+		uint32_t CopySubtree(uint32_t nodeIdx)
+		{
+			const uint32_t localRootIdx{ static_cast<uint32_t>(m_PageNodes.size()) };
+			m_PageNodes.push_back(m_Geometry.bvhNodes[nodeIdx]);
+
+			std::vector<std::pair<uint32_t, uint32_t>> toCopy{ { localRootIdx, nodeIdx } };
+			for (size_t i{}; i < toCopy.size(); ++i)
+			{
+				const auto [localIdx, globalIdx] { toCopy[i] };
+				const BVHNode& node{ m_Geometry.bvhNodes[globalIdx] };
+
+				if (node.IsLeaf())
+				{
+					m_PageNodes[localIdx].firstIndex = static_cast<uint32_t>(m_PageTriangles.size() * 3);
+					AppendTriangles(node.firstIndex, node.indexCount);
+					continue;
+				}
+
+				const uint32_t localChildIdx{ static_cast<uint32_t>(m_PageNodes.size()) };
+				m_PageNodes[localIdx].leftChild = localChildIdx;
+				m_PageNodes.push_back(m_Geometry.bvhNodes[node.leftChild]);
+				m_PageNodes.push_back(m_Geometry.bvhNodes[node.leftChild + 1]);
+				toCopy.emplace_back(localChildIdx, node.leftChild);
+				toCopy.emplace_back(localChildIdx + 1, node.leftChild + 1);
+			}
+
+			return localRootIdx;
+		}
+
+		//A leaf too big for a page is cut into page-sized leaves under extra top nodes
+		uint32_t WriteTriangleRange(uint32_t firstIndex, uint32_t indexCount)
+		{
+			const uint32_t maxIndices{ static_cast<uint32_t>((m_PageSize - GetPageBytes(1, 0)) / sizeof(PagedTriangle)) * 3 };
+			const uint32_t topIdx{ static_cast<uint32_t>(m_TopNodes.size()) };
+			m_TopNodes.emplace_back();
+
+			if (indexCount <= maxIndices)
+			{
+				ReservePage(1, indexCount / 3);
+
+				BVHNode leaf{};
+				leaf.minAABB = Vector3::Unit * FLT_MAX;
+				leaf.MaxAABB = Vector3::Unit * -FLT_MAX;
+				leaf.firstIndex = static_cast<uint32_t>(m_PageTriangles.size() * 3);
+				leaf.indexCount = indexCount;
+
+				const size_t firstTriangle{ m_PageTriangles.size() };
+				AppendTriangles(firstIndex, indexCount);
+				for (size_t i{ firstTriangle }; i < m_PageTriangles.size(); ++i)
+				{
+					for (const Vector3& vertex : { m_PageTriangles[i].v0, m_PageTriangles[i].v1, m_PageTriangles[i].v2 })
+					{
+						leaf.minAABB = Vector3::Min(leaf.minAABB, vertex);
+						leaf.MaxAABB = Vector3::Max(leaf.MaxAABB, vertex);
+					}
+				}
+
+				PagedMeshNode& topNode{ m_TopNodes[topIdx] };
+				topNode.minAABB = leaf.minAABB;
+				topNode.MaxAABB = leaf.MaxAABB;
+				topNode.pageIdx = m_NumPages;
+				topNode.pageNodeIdx = static_cast<uint32_t>(m_PageNodes.size());
+				m_PageNodes.push_back(leaf);
+				return topIdx;
+			}
+
+			const uint32_t leftCount{ indexCount / 6 * 3 };
+			const uint32_t leftIdx{ WriteTriangleRange(firstIndex, leftCount) };
+			const uint32_t rightIdx{ WriteTriangleRange(firstIndex + leftCount, indexCount - leftCount) };
+
+			PagedMeshNode& topNode{ m_TopNodes[topIdx] };
+			topNode.minAABB = Vector3::Min(m_TopNodes[leftIdx].minAABB, m_TopNodes[rightIdx].minAABB);
+			topNode.MaxAABB = Vector3::Max(m_TopNodes[leftIdx].MaxAABB, m_TopNodes[rightIdx].MaxAABB);
+			topNode.leftChild = leftIdx;
+			topNode.rightChild = rightIdx;
+			return topIdx;
+		}
+	};
+
+	//Rejects pages a traversal could run out of bounds or in circles in
+	bool IsPageValid(const PagedMeshPage& page, uint32_t pageSize)
+	{
+		if (page.numNodes == 0 || GetPageBytes(page.numNodes, page.numTriangles) > pageSize)
+			return false;
+
+		for (uint32_t nodeIdx{}; nodeIdx < page.numNodes; ++nodeIdx)
+		{
+			const BVHNode& node{ page.bvhNodes[nodeIdx] };
+			if (node.IsLeaf())
+			{
+				if (node.firstIndex % 3 != 0 || node.indexCount % 3 != 0 ||
+					node.firstIndex / 3 + node.indexCount / 3 > page.numTriangles)
+					return false;
+			}
+			else if (node.leftChild <= nodeIdx || node.leftChild + 1 >= page.numNodes)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+PagedMeshPage::~PagedMeshPage()
+{
+	if (!pMapping)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(pMapping);
+#else
+	munmap(pMapping, mappedSize);
+#endif
+}
+
+bool PagedMeshGeometry::Write(const MeshGeometry& geometry, const std::string& filename, uint32_t pageSize)
+{
+	if (geometry.bvhNodes.empty())
+	{
+		std::cout << "Can't page " << filename << ", the geometry has no BVH" << std::endl;
+		return false;
+	}
+
+	if (pageSize == 0 || pageSize % g_MappingGranularity != 0)
+	{
+		std::cout << "Can't page " << filename << ", the page size isn't a multiple of " << g_MappingGranularity << std::endl;
+		return false;
+	}
+
+	std::ofstream file{ filename, std::ios::binary };
+	if (!file)
+	{
+		std::cout << "Couldn't write " << filename << std::endl;
+		return false;
+	}
+
+	//Header page first, filled in once the page count is known
+	const std::vector<char> headerPage(pageSize);
+	file.write(headerPage.data(), headerPage.size());
+
+	PageWriter writer{ geometry, file, pageSize };
+	writer.WriteSubtree(0);
+	writer.Flush();
+
+	const std::vector<PagedMeshNode>& topNodes{ writer.GetTopNodes() };
+	file.write(reinterpret_cast<const char*>(topNodes.data()), topNodes.size() * sizeof(PagedMeshNode));
+
+	FileHeader header{};
+	std::memcpy(header.magic, g_Magic, sizeof(g_Magic));
+	header.version = g_Version;
+	header.pageSize = pageSize;
+	header.numPages = writer.GetPageCount();
+	header.numTopNodes = static_cast<uint32_t>(topNodes.size());
+	header.maxTrianglesPerPage = static_cast<uint32_t>((pageSize - GetPageBytes(1, 0)) / sizeof(PagedTriangle));
+	header.minAABB = geometry.minAABB;
+	header.maxAABB = geometry.maxAABB;
+
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	return static_cast<bool>(file);
+}
+
+int PagedMeshGeometry::Convert(const std::string& objFilename, const std::string& filename, uint32_t pageSize)
+{
+	MeshGeometry geometry{};
+	if (!Utils::ParseOBJ(objFilename, geometry.positions, geometry.normals, geometry.indices))
+	{
+		std::cout << "Couldn't read " << objFilename << std::endl;
+		return 1;
+	}
+
+	geometry.Build();
+	if (!Write(geometry, filename, pageSize))
+		return 1;
+
+	std::cout << "Paged " << objFilename << " to " << filename << ": " << geometry.GetIndexCount() / 3 << " triangles in pages of "
+		<< pageSize / 1024 << " KiB" << std::endl;
+	return 0;
+}
+
+std::shared_ptr<PagedMeshGeometry> PagedMeshGeometry::Open(const std::string& filename, size_t residentBudgetBytes)
+{
+	std::ifstream file{ filename, std::ios::binary };
+	FileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!file || std::memcmp(header.magic, g_Magic, sizeof(g_Magic)) != 0 || header.version != g_Version ||
+		header.pageSize == 0 || header.pageSize % g_MappingGranularity != 0 || header.numTopNodes == 0)
+	{
+		std::cout << filename << ": not a paged mesh of version " << g_Version << std::endl;
+		return nullptr;
+	}
+
+	auto pGeometry{ std::make_shared<PagedMeshGeometry>() };
+	pGeometry->m_Filename = filename;
+	pGeometry->m_PageSize = header.pageSize;
+	pGeometry->m_NumPages = header.numPages;
+	pGeometry->m_MaxTrianglesPerPage = header.maxTrianglesPerPage;
+	pGeometry->m_MaxResidentPages = std::max<size_t>(residentBudgetBytes / header.pageSize, 1);
+	pGeometry->m_MinAABB = header.minAABB;
+	pGeometry->m_MaxAABB = header.maxAABB;
+	pGeometry->m_PageSlots = std::make_unique<PageSlot[]>(header.numPages);
+	pGeometry->m_IsPageCorrupt.resize(header.numPages);
+
+	file.seekg(static_cast<std::streamoff>(header.numPages + 1) * header.pageSize);
+	pGeometry->m_TopNodes.resize(header.numTopNodes);
+	file.read(reinterpret_cast<char*>(pGeometry->m_TopNodes.data()), header.numTopNodes * sizeof(PagedMeshNode));
+	if (!file)
+	{
+		std::cout << filename << ": truncated paged mesh" << std::endl;
+		return nullptr;
+	}
+
+	//Children come after their parent, so traversals always terminate
+	const std::vector<PagedMeshNode>& topNodes{ pGeometry->m_TopNodes };
+	for (uint32_t nodeIdx{}; nodeIdx < topNodes.size(); ++nodeIdx)
+	{
+		const PagedMeshNode& node{ topNodes[nodeIdx] };
+		const bool isValid{ node.IsPage() ? node.pageIdx < header.numPages :
+			node.leftChild > nodeIdx && node.rightChild > nodeIdx && node.leftChild < topNodes.size() && node.rightChild < topNodes.size() };
+		if (!isValid)
+		{
+			std::cout << filename << ": corrupt top tree" << std::endl;
+			return nullptr;
+		}
+	}
+
+#ifdef _WIN32
+	const HANDLE fileHandle{ CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr) };
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Couldn't open " << filename << std::endl;
+		return nullptr;
+	}
+	pGeometry->m_FileHandle = fileHandle;
+
+	pGeometry->m_MappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!pGeometry->m_MappingHandle)
+	{
+		std::cout << "Couldn't map " << filename << std::endl;
+		return nullptr;
+	}
+#else
+	pGeometry->m_FileDescriptor = open(filename.c_str(), O_RDONLY);
+	if (pGeometry->m_FileDescriptor < 0)
+	{
+		std::cout << "Couldn't open " << filename << std::endl;
+		return nullptr;
+	}
+#endif
+
+	return pGeometry;
+}
+
+PagedMeshGeometry::~PagedMeshGeometry()
+{
+	//Pages still held elsewhere stay readable, a view outlives the handles it was mapped from
+#ifdef _WIN32
+	if (m_MappingHandle)
+		CloseHandle(m_MappingHandle);
+	if (m_FileHandle)
+		CloseHandle(m_FileHandle);
+#else
+	if (m_FileDescriptor >= 0)
+		close(m_FileDescriptor);
+#endif
+}
+
+std::shared_ptr<const PagedMeshPage> PagedMeshGeometry::MapPage(uint32_t pageIdx) const
+{
+	const uint64_t offset{ (static_cast<uint64_t>(pageIdx) + 1) * m_PageSize };
+
+	auto pPage{ std::make_shared<PagedMeshPage>() };
+#ifdef _WIN32
+	pPage->pMapping = MapViewOfFile(m_MappingHandle, FILE_MAP_READ, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), m_PageSize);
+	if (!pPage->pMapping)
+		return nullptr;
+#else
+	void* pMapping{ mmap(nullptr, m_PageSize, PROT_READ, MAP_PRIVATE, m_FileDescriptor, static_cast<off_t>(offset)) };
+	if (pMapping == MAP_FAILED)
+		return nullptr;
+	pPage->pMapping = pMapping;
+#endif
+	pPage->mappedSize = m_PageSize;
+
+	const std::byte* pData{ static_cast<const std::byte*>(pPage->pMapping) };
+	PageHeader header{};
+	std::memcpy(&header, pData, sizeof(header));
+
+	pPage->numNodes = header.numNodes;
+	pPage->numTriangles = header.numTriangles;
+	pPage->bvhNodes = reinterpret_cast<const BVHNode*>(pData + sizeof(PageHeader));
+	pPage->triangles = reinterpret_cast<const PagedTriangle*>(pData + sizeof(PageHeader) + header.numNodes * sizeof(BVHNode));
+
+	if (!IsPageValid(*pPage, m_PageSize))
+		return nullptr;
+
+	return pPage;
+}
+
+std::shared_ptr<const PagedMeshPage> PagedMeshGeometry::AcquirePage(uint32_t pageIdx) const
+{
+	if (std::shared_ptr<const PagedMeshPage> pPage{ FindResidentPage(pageIdx) })
+		return pPage;
+
+	{
+		const std::lock_guard lock{ m_CacheMutex };
+		if (pageIdx >= m_NumPages || m_IsPageCorrupt[pageIdx])
+			return nullptr;
+	}
+
+	//Mapped and checked outside the lock, that's where the disk gets read
+	std::shared_ptr<const PagedMeshPage> pPage{ MapPage(pageIdx) };
+
+	const std::lock_guard lock{ m_CacheMutex };
+	if (!pPage)
+	{
+		if (!m_IsPageCorrupt[pageIdx])
+			std::cout << m_Filename << ": page " << pageIdx << " is corrupt or can't be mapped, its triangles are skipped" << std::endl;
+		m_IsPageCorrupt[pageIdx] = true;
+		return nullptr;
+	}
+
+	//Another thread faulted the same page in meanwhile, ours is unmapped on return
+	PageSlot& slot{ m_PageSlots[pageIdx] };
+	if (std::shared_ptr<const PagedMeshPage> pResidentPage{ slot.pPage.load() })
+		return pResidentPage;
+
+	if (m_ResidentPages.size() < m_MaxResidentPages)
+	{
+		m_ResidentPages.push_back(pageIdx);
+	}
+	else
+	{
+		//Pages used since the hand last passed get a second chance. Traversals keep setting the bits while
+		//it sweeps, after two full turns the page under the hand goes regardless
+		for (size_t step{}; step < 2 * m_ResidentPages.size(); ++step)
+		{
+			if (!m_PageSlots[m_ResidentPages[m_ClockHand]].isReferenced.exchange(false, std::memory_order_relaxed))
+				break;
+			m_ClockHand = (m_ClockHand + 1) % m_ResidentPages.size();
+		}
+
+		//Traversals still holding the page keep it mapped until they're done
+		m_PageSlots[m_ResidentPages[m_ClockHand]].pPage.store(nullptr);
+		++m_NumEvictions;
+
+		m_ResidentPages[m_ClockHand] = pageIdx;
+		m_ClockHand = (m_ClockHand + 1) % m_ResidentPages.size();
+	}
+
+	//Counted here only, a page another thread installed first or one that's corrupt didn't fault anything in
+	++m_NumPageFaults;
+	slot.isReferenced.store(true, std::memory_order_relaxed);
+	slot.pPage.store(pPage);
+	return pPage;
+}
+
+std::shared_ptr<const PagedMeshPage> PagedMeshGeometry::FindResidentPage(uint32_t pageIdx) const
+{
+	if (pageIdx >= m_NumPages)
+		return nullptr;
+
+	PageSlot& slot{ m_PageSlots[pageIdx] };
+	std::shared_ptr<const PagedMeshPage> pPage{ slot.pPage.load() };
+
+	//Only written when cleared, a bit every thread keeps storing to would bounce its cache line around
+	if (pPage && !slot.isReferenced.load(std::memory_order_relaxed))
+		slot.isReferenced.store(true, std::memory_order_relaxed);
+
+	return pPage;
+}
+
+size_t PagedMeshGeometry::GetResidentPageCount() const
+{
+	const std::lock_guard lock{ m_CacheMutex };
+	return m_ResidentPages.size();
+}
+
+uint64_t PagedMeshGeometry::GetPageFaultCount() const
+{
+	const std::lock_guard lock{ m_CacheMutex };
+	return m_NumPageFaults;
+}
+
+uint64_t PagedMeshGeometry::GetEvictionCount() const
+{
+	const std::lock_guard lock{ m_CacheMutex };
+	return m_NumEvictions;
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//De-indexed triangle as stored in a page, so a page never needs vertices from another one
+	struct PagedTriangle
+	{
+		Vector3 v0{};
+		Vector3 v1{};
+		Vector3 v2{};
+		Vector3 normal{};
+	};
+
+	//Node of the always resident top tree. Its leaves point at a BVH subtree inside a page
+	struct PagedMeshNode
+	{
+		Vector3 minAABB{};
+		Vector3 MaxAABB{};
+		uint32_t leftChild{};
+		uint32_t rightChild{};
+		//UINT32_MAX for inner nodes
+		uint32_t pageIdx{ UINT32_MAX };
+		uint32_t pageNodeIdx{};
+
+		bool IsPage() const { return pageIdx != UINT32_MAX; }
+	};
+
+	//A mapped page: BVH nodes with the triangles they index, laid out like a MeshGeometry so IntersectBVH
+	//runs on it unchanged. Unmapped when the cache and every traversal using it have let go
+	struct PagedMeshPage
+	{
+		PagedMeshPage() = default;
+		~PagedMeshPage();
+
+		PagedMeshPage(const PagedMeshPage&) = delete;
+		PagedMeshPage(PagedMeshPage&&) noexcept = delete;
+		PagedMeshPage& operator=(const PagedMeshPage&) = delete;
+		PagedMeshPage& operator=(PagedMeshPage&&) noexcept = delete;
+
+		const BVHNode* bvhNodes{};
+		const PagedTriangle* triangles{};
+		uint32_t numNodes{};
+		uint32_t numTriangles{};
+
+		void* pMapping{};
+		size_t mappedSize{};
+
+		void FetchTriangle(size_t firstIndex, Triangle& triangle) const
+		{
+			const PagedTriangle& pagedTriangle{ triangles[firstIndex / 3] };
+			triangle.v0 = pagedTriangle.v0;
+			triangle.v1 = pagedTriangle.v1;
+			triangle.v2 = pagedTriangle.v2;
+			triangle.normal = pagedTriangle.normal;
+		}
+	};
+
+	//Mesh too large for memory, kept in a .pmesh file of fixed-size pages that are memory-mapped on first use.
+	//At most the resident budget stays mapped, past it a clock sweep evicts a page that wasn't used since the
+	//last sweep. Only the top tree and a slot per page are always in memory
+	class PagedMeshGeometry final
+	{
+	public:
+		//Splits the geometry's BVH into subtrees that fit a page, pageSize has to be a multiple of 64 KiB
+		//(the mapping granularity on Windows). Works on built geometry, compressed or not
+		static bool Write(const MeshGeometry& geometry, const std::string& filename, uint32_t pageSize = 1 << 16);
+
+		//.obj to .pmesh, for RayTracer --page-mesh. Returns the process exit code
+		static int Convert(const std::string& objFilename, const std::string& filename, uint32_t pageSize = 1 << 16);
+
+		//Nullptr, with the reason printed, when the file can't be used
+		static std::shared_ptr<PagedMeshGeometry> Open(const std::string& filename, size_t residentBudgetBytes);
+
+		PagedMeshGeometry() = default;
+		~PagedMeshGeometry();
+
+		PagedMeshGeometry(const PagedMeshGeometry&) = delete;
+		PagedMeshGeometry(PagedMeshGeometry&&) noexcept = delete;
+		PagedMeshGeometry& operator=(const PagedMeshGeometry&) = delete;
+		PagedMeshGeometry& operator=(PagedMeshGeometry&&) noexcept = delete;
+
+		const Vector3& GetMinAABB() const { return m_MinAABB; }
+		const Vector3& GetMaxAABB() const { return m_MaxAABB; }
+		const std::vector<PagedMeshNode>& GetTopNodes() const { return m_TopNodes; }
+		//Page triangle indices are at most this, so pageIdx * max + triangleIdx names a triangle of the mesh
+		uint32_t GetMaxTrianglesPerPage() const { return m_MaxTrianglesPerPage; }
+
+		//Maps the page when it isn't resident. Thread safe, holding the result keeps the page mapped.
+		//Only a page fault takes the lock
+		std::shared_ptr<const PagedMeshPage> AcquirePage(uint32_t pageIdx) const;
+		//Like AcquirePage but never maps anything, for guesses that aren't worth a page fault. Lock free
+		std::shared_ptr<const PagedMeshPage> FindResidentPage(uint32_t pageIdx) const;
+
+		uint32_t GetPageCount() const { return m_NumPages; }
+		uint32_t GetPageSize() const { return m_PageSize; }
+		size_t GetResidentPageCount() const;
+		uint64_t GetPageFaultCount() const;
+		uint64_t GetEvictionCount() const;
+
+	private:
+		std::shared_ptr<const PagedMeshPage> MapPage(uint32_t pageIdx) const;
+
+		std::string m_Filename{};
+		uint32_t m_PageSize{};
+		uint32_t m_NumPages{};
+		uint32_t m_MaxTrianglesPerPage{};
+		size_t m_MaxResidentPages{};
+
+		Vector3 m_MinAABB{};
+		Vector3 m_MaxAABB{};
+		std::vector<PagedMeshNode> m_TopNodes{};
+
+#ifdef _WIN32
+		void* m_FileHandle{};
+		void* m_MappingHandle{};
+#else
+		int m_FileDescriptor{ -1 };
+#endif
+
+		//Every traversal reads these, so a resident page is found without taking the lock
+		struct PageSlot
+		{
+			std::atomic<std::shared_ptr<const PagedMeshPage>> pPage{};
+			//Set on every use, the clock sweep clears it and evicts the page when it finds it cleared
+			std::atomic<bool> isReferenced{};
+		};
+		std::unique_ptr<PageSlot[]> m_PageSlots{};
+
+		//Page faults and evictions only, the bookkeeping below is never touched by a hit
+		mutable std::mutex m_CacheMutex{};
+		//Indices of the resident pages, the clock hand sweeps over them
+		mutable std::vector<uint32_t> m_ResidentPages{};
+		mutable size_t m_ClockHand{};
+		mutable std::vector<bool> m_IsPageCorrupt{};
+		mutable uint64_t m_NumPageFaults{};
+		mutable uint64_t m_NumEvictions{};
+	};
+}
@@ -0,0 +1,237 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+using namespace dae;
+
+namespace dae
+{
+	//Registers the thread on first use, the profiler drops its buffer once it has been read after the thread ended
+	struct ProfilerThreadSlot
+	{
+		ProfilerThreadSlot() :
+			pData{ Profiler::Get().RegisterThread() }
+		{
+		}
+
+		~ProfilerThreadSlot()
+		{
+			pData->isRetired.store(true, std::memory_order_release);
+		}
+
+		Profiler::ThreadData* pData;
+	};
+}
+
+Profiler& Profiler::Get()
+{
+	static Profiler profiler{};
+	return profiler;
+}
+
+Profiler::Profiler() :
+	m_StartTime{ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) },
+	m_SecondsPerTick{ static_cast<double>(std::chrono::steady_clock::period::num) / std::chrono::steady_clock::period::den }
+{
+}
+
+void Profiler::SetEnabled(bool isEnabled)
+{
+	if (isEnabled && !IsEnabled())
+	{
+		//Fresh capture, drop whatever was left over from the previous one
+		std::lock_guard lock{ m_ThreadsMutex };
+		m_Frames.clear();
+		m_Events.clear();
+		for (auto& pThread : m_Threads)
+		{
+			pThread->events.clear();
+			for (auto& ticks : pThread->stageTicks)
+			{
+				ticks.store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	m_IsEnabled.store(isEnabled, std::memory_order_relaxed);
+}
+
+uint64_t Profiler::GetTimestamp() const
+{
+	return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) - m_StartTime;
+}
+
+void Profiler::AddSample(ProfileStage stage, uint64_t start, uint64_t end)
+{
+	ThreadData& threadData{ GetThreadData() };
+
+	//Only this thread writes its counters, no read-modify-write needed
+	std::atomic<uint64_t>& ticks{ threadData.stageTicks[static_cast<int>(stage)] };
+	ticks.store(ticks.load(std::memory_order_relaxed) + (end - start), std::memory_order_relaxed);
+
+	if (!IsPerPixelStage(stage))
+		threadData.events.push_back(Event{ stage, threadData.threadId, start, end });
+}
+
+void Profiler::EndFrame()
+{
+	if (!IsEnabled())
+		return;
+
+	FrameRecord frame{};
+	frame.end = GetTimestamp();
+
+	std::lock_guard lock{ m_ThreadsMutex };
+	for (auto& pThread : m_Threads)
+	{
+		for (int stage{}; stage < static_cast<int>(ProfileStage::Count); ++stage)
+		{
+			const uint64_t ticks{ pThread->stageTicks[stage].exchange(0, std::memory_order_relaxed) };
+			frame.stageTimes[stage] += static_cast<float>(ticks * m_SecondsPerTick * 1000.0);
+		}
+
+		m_Events.insert(m_Events.end(), pThread->events.begin(), pThread->events.end());
+		pThread->events.clear();
+	}
+
+	m_Threads.erase(std::remove_if(m_Threads.begin(), m_Threads.end(),
+		[](const std::unique_ptr<ThreadData>& pThread) { return pThread->isRetired.load(std::memory_order_acquire); }),
+		m_Threads.end());
+
+	m_Frames.push_back(frame);
+
+	//Keep memory bounded on long captures, the oldest frames go first
+	if (m_Frames.size() > m_MaxFrames)
+	{
+		m_Frames.erase(m_Frames.begin());
+
+		const uint64_t firstFrameStart{ m_Frames.front().end };
+		m_Events.erase(std::remove_if(m_Events.begin(), m_Events.end(),
+			[firstFrameStart](const Event& event) { return event.end < firstFrameStart; }),
+			m_Events.end());
+	}
+}
+
+bool Profiler::ExportChromeTrace(const std::string& filename) const
+{
+	std::ofstream file{ filename };
+	if (!file)
+		return false;
+
+	const double microsecondsPerTick{ m_SecondsPerTick * 1'000'000.0 };
+
+	std::lock_guard lock{ m_ThreadsMutex };
+
+	file << "{\"traceEvents\":[\n";
+	bool isFirst{ true };
+
+	for (const Event& event : m_Events)
+	{
+		file << (isFirst ? "" : ",\n")
+			<< "{\"name\":\"" << GetStageName(event.stage) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.threadId
+			<< ",\"ts\":" << event.start * microsecondsPerTick
+			<< ",\"dur\":" << (event.end - event.start) * microsecondsPerTick << "}";
+		isFirst = false;
+	}
+
+	//Per-pixel stages have no single begin and end, they show up as a counter track per frame
+	for (const FrameRecord& frame : m_Frames)
+	{
+		file << (isFirst ? "" : ",\n")
+			<< "{\"name\":\"CPU time per frame (ms)\",\"ph\":\"C\",\"pid\":0,\"ts\":" << frame.end * microsecondsPerTick << ",\"args\":{";
+		isFirst = false;
+
+		bool isFirstArg{ true };
+		for (int stage{}; stage < static_cast<int>(ProfileStage::Count); ++stage)
+		{
+			if (!IsPerPixelStage(static_cast<ProfileStage>(stage)))
+				continue;
+
+			file << (isFirstArg ? "" : ",") << "\"" << GetStageName(static_cast<ProfileStage>(stage)) << "\":" << frame.stageTimes[stage];
+			isFirstArg = false;
+		}
+		file << "}}";
+	}
+
+	file << "\n]}\n";
+	return true;
+}
+
+void Profiler::PrintSummary() const
+{
+	std::lock_guard lock{ m_ThreadsMutex };
+
+	if (m_Frames.empty())
+	{
+		std::cout << "**PROFILER** no frames captured\n";
+		return;
+	}
+
+	std::cout << "**PROFILER** average over " << m_Frames.size() << " frames\n";
+	for (int stage{}; stage < static_cast<int>(ProfileStage::Count); ++stage)
+	{
+		float total{};
+		float highest{};
+		for (const FrameRecord& frame : m_Frames)
+		{
+			total += frame.stageTimes[stage];
+			highest = std::max(highest, frame.stageTimes[stage]);
+		}
+
+		std::cout << ">> " << GetStageName(static_cast<ProfileStage>(stage)) << " = "
+			<< total / m_Frames.size() << " ms (max " << highest << " ms)"
+			<< (IsPerPixelStage(static_cast<ProfileStage>(stage)) ? " [cpu, all threads]" : "") << std::endl;
+	}
+}
+
+float Profiler::GetLastFrameTime(ProfileStage stage) const
+{
+	std::lock_guard lock{ m_ThreadsMutex };
+	return m_Frames.empty() ? 0.f : m_Frames.back().stageTimes[static_cast<int>(stage)];
+}
+
+Profiler::ThreadData* Profiler::RegisterThread()
+{
+	std::lock_guard lock{ m_ThreadsMutex };
+
+	m_Threads.push_back(std::make_unique<ThreadData>());
+	m_Threads.back()->threadId = m_NextThreadId++;
+	return m_Threads.back().get();
+}
+
+Profiler::ThreadData& Profiler::GetThreadData()
+{
+	thread_local ProfilerThreadSlot slot{};
+	return *slot.pData;
+}
+
+bool Profiler::IsPerPixelStage(ProfileStage stage)
+{
+	return stage == ProfileStage::PrimaryRays || stage == ProfileStage::ShadowRays || stage == ProfileStage::Shading;
+}
+
+const char* Profiler::GetStageName(ProfileStage stage)
+{
+	switch (stage)
+	{
+	case ProfileStage::SceneUpdate:
+		return "SceneUpdate";
+	case ProfileStage::BVHRebuild:
+		return "BVHRebuild";
+	case ProfileStage::Trace:
+		return "Trace";
+	case ProfileStage::PrimaryRays:
+		return "PrimaryRays";
+	case ProfileStage::ShadowRays:
+		return "ShadowRays";
+	case ProfileStage::Shading:
+		return "Shading";
+	case ProfileStage::Present:
+		return "Present";
+	default:
+		return "Unknown";
+	}
+}
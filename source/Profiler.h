@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Comment out to compile every PROFILE_SCOPE away
+#define PROFILING
+
+namespace dae
+{
+	enum class ProfileStage
+	{
+		SceneUpdate,
+		BVHRebuild,
+		Trace,
+		PrimaryRays,
+		ShadowRays,
+		Shading,
+		Present,
+
+		Count
+	};
+
+	//Collects per-stage timings per frame. Every thread writes to its own buffer without locking,
+	//EndFrame sums them up, so it has to be called while no frame is being traced.
+	//Per-pixel stages (primary rays, shadow rays, shading) are summed CPU time over all threads,
+	//the other stages are wall time and also kept as individual events for the Chrome trace.
+	class Profiler final
+	{
+	public:
+		static Profiler& Get();
+
+		~Profiler() = default;
+
+		Profiler(const Profiler&) = delete;
+		Profiler(Profiler&&) noexcept = delete;
+		Profiler& operator=(const Profiler&) = delete;
+		Profiler& operator=(Profiler&&) noexcept = delete;
+
+		void SetEnabled(bool isEnabled);
+		bool IsEnabled() const { return m_IsEnabled.load(std::memory_order_relaxed); }
+
+		void EndFrame();
+
+		//Open the json in chrome://tracing or ui.perfetto.dev
+		bool ExportChromeTrace(const std::string& filename) const;
+		void PrintSummary() const;
+
+		uint64_t GetTimestamp() const;
+		void AddSample(ProfileStage stage, uint64_t start, uint64_t end);
+
+		float GetLastFrameTime(ProfileStage stage) const;
+
+		static bool IsPerPixelStage(ProfileStage stage);
+		static const char* GetStageName(ProfileStage stage);
+
+	private:
+		Profiler();
+
+		struct Event
+		{
+			ProfileStage stage{};
+			uint32_t threadId{};
+			uint64_t start{};
+			uint64_t end{};
+		};
+
+		struct ThreadData
+		{
+			uint32_t threadId{};
+			std::atomic<uint64_t> stageTicks[static_cast<int>(ProfileStage::Count)]{};
+			std::vector<Event> events{};
+			std::atomic<bool> isRetired{};
+		};
+
+		struct FrameRecord
+		{
+			uint64_t end{};
+			float stageTimes[static_cast<int>(ProfileStage::Count)]{};
+		};
+
+		friend struct ProfilerThreadSlot;
+		ThreadData* RegisterThread();
+		ThreadData& GetThreadData();
+
+		std::atomic<bool> m_IsEnabled{};
+		uint64_t m_StartTime{};
+		double m_SecondsPerTick{};
+
+		mutable std::mutex m_ThreadsMutex{};
+		std::vector<std::unique_ptr<ThreadData>> m_Threads{};
+		uint32_t m_NextThreadId{};
+
+		static constexpr size_t m_MaxFrames{ 1000 };
+		std::vector<FrameRecord> m_Frames{};
+		std::vector<Event> m_Events{};
+	};
+
+	class ProfileScope final
+	{
+	public:
+		ProfileScope(ProfileStage stage) :
+			m_Stage{ stage },
+			m_IsActive{ Profiler::Get().IsEnabled() },
+			m_Start{ m_IsActive ? Profiler::Get().GetTimestamp() : 0 }
+		{
+		}
+
+		~ProfileScope()
+		{
+			if (m_IsActive)
+				Profiler::Get().AddSample(m_Stage, m_Start, Profiler::Get().GetTimestamp());
+		}
+
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope(ProfileScope&&) noexcept = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+		ProfileScope& operator=(ProfileScope&&) noexcept = delete;
+
+	private:
+		ProfileStage m_Stage;
+		bool m_IsActive;
+		uint64_t m_Start;
+	};
+}
+
+#ifdef PROFILING
+#define PROFILE_SCOPE_NAME(line) profileScope##line
+#define PROFILE_SCOPE_LINE(stage, line) dae::ProfileScope PROFILE_SCOPE_NAME(line){ stage }
+#define PROFILE_SCOPE(stage) PROFILE_SCOPE_LINE(stage, __LINE__)
+#else
+#define PROFILE_SCOPE(stage)
+#endif // PROFILING
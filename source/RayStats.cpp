@@ -0,0 +1,125 @@
+#include "RayStats.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace dae;
+
+namespace dae
+{
+	//Registers the thread on first use, the counters are dropped once they have been read after the thread ended
+	struct RayStatsThreadSlot
+	{
+		RayStatsThreadSlot() :
+			pCounters{ RayStats::Get().RegisterThread() }
+		{
+		}
+
+		~RayStatsThreadSlot()
+		{
+			pCounters->isRetired.store(true, std::memory_order_release);
+		}
+
+		RayStats::ThreadCounters* pCounters;
+	};
+}
+
+float RayStatsFrame::GetMRaysPerSecond() const
+{
+	if (traceTime <= 0.f)
+		return 0.f;
+
+	return static_cast<float>(GetRayCount()) / traceTime / 1'000'000.f;
+}
+
+float RayStatsFrame::GetTestsPerRay() const
+{
+	const uint64_t rayCount{ GetRayCount() };
+	if (rayCount == 0)
+		return 0.f;
+
+	const uint64_t testCount{ Get(RayCounter::SlabTests) + Get(RayCounter::TriangleTests) + Get(RayCounter::SphereTests) + Get(RayCounter::PlaneTests) };
+	return static_cast<float>(testCount) / rayCount;
+}
+
+float RayStatsFrame::GetOccluderCacheHitRate() const
+{
+	const uint64_t testCount{ Get(RayCounter::OccluderCacheTests) };
+	if (testCount == 0)
+		return 0.f;
+
+	return static_cast<float>(Get(RayCounter::OccluderCacheHits)) / testCount;
+}
+
+RayStats& RayStats::Get()
+{
+	static RayStats rayStats{};
+	return rayStats;
+}
+
+void RayStats::Increment(RayCounter counter)
+{
+	//Single writer per counter, no read-modify-write needed
+	std::atomic<uint64_t>& value{ GetThreadCounters().counters[static_cast<int>(counter)] };
+	value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+uint64_t RayStats::GetThreadCount(RayCounter counter)
+{
+	return GetThreadCounters().counters[static_cast<int>(counter)].load(std::memory_order_relaxed);
+}
+
+RayStatsFrame RayStats::EndFrame(float traceTime)
+{
+	RayStatsFrame frame{};
+	frame.traceTime = traceTime;
+
+	std::lock_guard lock{ m_ThreadsMutex };
+	for (auto& pThread : m_Threads)
+	{
+		for (int counter{}; counter < static_cast<int>(RayCounter::Count); ++counter)
+		{
+			frame.counters[counter] += pThread->counters[counter].exchange(0, std::memory_order_relaxed);
+		}
+	}
+
+	m_Threads.erase(std::remove_if(m_Threads.begin(), m_Threads.end(),
+		[](const std::unique_ptr<ThreadCounters>& pThread) { return pThread->isRetired.load(std::memory_order_acquire); }),
+		m_Threads.end());
+
+	//A converged frame casts no rays, keep showing the last traced one
+	if (frame.GetRayCount() > 0)
+		m_LastFrame = frame;
+
+	return frame;
+}
+
+void RayStats::PrintLastFrame() const
+{
+	const RayStatsFrame& frame{ m_LastFrame };
+
+	std::cout << "**RAYSTATS** " << frame.GetMRaysPerSecond() << " Mrays/s, " << frame.GetTestsPerRay() << " tests/ray\n"
+		<< ">> rays = " << frame.Get(RayCounter::PrimaryRays) << " primary (" << frame.Get(RayCounter::PrimaryHits) << " hit), "
+		<< frame.Get(RayCounter::ShadowRays) << " shadow (" << frame.Get(RayCounter::ShadowHits) << " occluded)\n"
+		<< ">> bvh nodes visited = " << frame.Get(RayCounter::BVHNodesVisited) << ", slab tests = " << frame.Get(RayCounter::SlabTests) << "\n"
+		<< ">> triangle tests = " << frame.Get(RayCounter::TriangleTests) << ", sphere tests = " << frame.Get(RayCounter::SphereTests)
+		<< ", plane tests = " << frame.Get(RayCounter::PlaneTests) << "\n"
+		<< ">> occluder cache = " << frame.Get(RayCounter::OccluderCacheHits) << " hits of " << frame.Get(RayCounter::OccluderCacheTests)
+		<< " tests (" << frame.GetOccluderCacheHitRate() * 100.f << "%)\n"
+		<< ">> shadow grid = " << frame.Get(RayCounter::ShadowGridResolved) << " resolved of " << frame.Get(RayCounter::ShadowGridLookups)
+		<< " lookups" << std::endl;
+}
+
+RayStats::ThreadCounters* RayStats::RegisterThread()
+{
+	std::lock_guard lock{ m_ThreadsMutex };
+
+	m_Threads.push_back(std::make_unique<ThreadCounters>());
+	return m_Threads.back().get();
+}
+
+RayStats::ThreadCounters& RayStats::GetThreadCounters()
+{
+	thread_local RayStatsThreadSlot slot{};
+	return *slot.pCounters;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//Uncomment for a stats build, every RAY_STATS_INC compiles away otherwise
+//#define RAY_STATS
+
+namespace dae
+{
+	enum class RayCounter
+	{
+		PrimaryRays,
+		ShadowRays,
+		PrimaryHits,
+		ShadowHits,
+		BVHNodesVisited,
+		SlabTests,
+		TriangleTests,
+		SphereTests,
+		PlaneTests,
+		OccluderCacheTests,
+		OccluderCacheHits,
+		ShadowGridLookups,
+		ShadowGridResolved,
+
+		Count
+	};
+
+	struct RayStatsFrame
+	{
+		uint64_t counters[static_cast<int>(RayCounter::Count)]{};
+		float traceTime{};
+
+		uint64_t Get(RayCounter counter) const { return counters[static_cast<int>(counter)]; }
+		uint64_t GetRayCount() const { return Get(RayCounter::PrimaryRays) + Get(RayCounter::ShadowRays); }
+		float GetMRaysPerSecond() const;
+		//Slab, triangle, sphere and plane tests per cast ray
+		float GetTestsPerRay() const;
+		//Share of shadow rays that were settled by the cached occluder alone
+		float GetOccluderCacheHitRate() const;
+	};
+
+	//Per-thread traversal counters. Only the owning thread writes its counters,
+	//EndFrame sums them up, so it has to be called while no frame is being traced.
+	class RayStats final
+	{
+	public:
+		static RayStats& Get();
+
+		~RayStats() = default;
+
+		RayStats(const RayStats&) = delete;
+		RayStats(RayStats&&) noexcept = delete;
+		RayStats& operator=(const RayStats&) = delete;
+		RayStats& operator=(RayStats&&) noexcept = delete;
+
+		static void Increment(RayCounter counter);
+		//Running total of the calling thread since the last EndFrame
+		static uint64_t GetThreadCount(RayCounter counter);
+
+		//Returns the frame that just ended, converged frames that cast no rays included
+		RayStatsFrame EndFrame(float traceTime);
+		const RayStatsFrame& GetLastFrame() const { return m_LastFrame; }
+		void PrintLastFrame() const;
+
+	private:
+		RayStats() = default;
+
+		struct ThreadCounters
+		{
+			std::atomic<uint64_t> counters[static_cast<int>(RayCounter::Count)]{};
+			std::atomic<bool> isRetired{};
+		};
+
+		friend struct RayStatsThreadSlot;
+		ThreadCounters* RegisterThread();
+		static ThreadCounters& GetThreadCounters();
+
+		std::mutex m_ThreadsMutex{};
+		std::vector<std::unique_ptr<ThreadCounters>> m_Threads{};
+
+		RayStatsFrame m_LastFrame{};
+	};
+}
+
+#ifdef RAY_STATS
+#define RAY_STATS_INC(counter) dae::RayStats::Increment(dae::RayCounter::counter)
+#else
+#define RAY_STATS_INC(counter)
+#endif // RAY_STATS
@@ -0,0 +1,245 @@
+#include "RenderTarget.h"
+
+#include <algorithm>
+#include <cassert>
+
+//External includes
+#include "SDL.h"
+#include "SDL_surface.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define SSE_PACK
+#include <emmintrin.h>
+#endif
+
+using namespace dae;
+
+namespace
+{
+	//4x4 Bayer matrix, offsets in (0, 1) added before truncating to 8 bit
+	constexpr float g_DitherMatrix[4][4]
+	{
+		{  0.5f / 16.f,  8.5f / 16.f,  2.5f / 16.f, 10.5f / 16.f },
+		{ 12.5f / 16.f,  4.5f / 16.f, 14.5f / 16.f,  6.5f / 16.f },
+		{  3.5f / 16.f, 11.5f / 16.f,  1.5f / 16.f,  9.5f / 16.f },
+		{ 15.5f / 16.f,  7.5f / 16.f, 13.5f / 16.f,  5.5f / 16.f },
+	};
+
+	//ACES filmic curve fit by Krzysztof Narkowicz
+	constexpr float g_AcesA{ 2.51f };
+	constexpr float g_AcesB{ 0.03f };
+	constexpr float g_AcesC{ 2.43f };
+	constexpr float g_AcesD{ 0.59f };
+	constexpr float g_AcesE{ 0.14f };
+
+	float ACES(float x)
+	{
+		return std::min((x * (g_AcesA * x + g_AcesB)) / (x * (g_AcesC * x + g_AcesD) + g_AcesE), 1.f);
+	}
+}
+
+RenderTarget::RenderTarget(SDL_Surface* pSurface) :
+	m_pSurfacePixels(static_cast<uint32_t*>(pSurface->pixels)),
+	m_SurfacePitch(pSurface->pitch / 4),
+	m_Width(pSurface->w),
+	m_Height(pSurface->h),
+	m_RedShift(pSurface->format->Rshift),
+	m_GreenShift(pSurface->format->Gshift),
+	m_BlueShift(pSurface->format->Bshift),
+	m_AlphaMask(pSurface->format->Amask)
+{
+	//Window surfaces are 32 bit, the packing below relies on it
+	assert(pSurface->format->BytesPerPixel == 4);
+
+	m_NumTilesX = (m_Width + m_TileWidth - 1) / m_TileWidth;
+	m_NumTilesY = (m_Height + m_TileHeight - 1) / m_TileHeight;
+
+	for (auto& buffer : m_Buffers)
+	{
+		buffer.resize(static_cast<size_t>(m_Width) * m_Height);
+	}
+
+	m_SRGBTable.resize(m_SRGBTableSize);
+	for (int i{}; i < m_SRGBTableSize; ++i)
+	{
+		const float linear{ i / static_cast<float>(m_SRGBTableSize - 1) };
+		const float encoded{ linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.f / 2.4f) - 0.055f };
+		m_SRGBTable[i] = encoded * 255.f;
+	}
+}
+
+void RenderTarget::ResolveTile(uint32_t tileIndex) const
+{
+	const int startX{ static_cast<int>(tileIndex % m_NumTilesX) * m_TileWidth };
+	const int startY{ static_cast<int>(tileIndex / m_NumTilesX) * m_TileHeight };
+
+	const int count{ std::min(m_TileWidth, m_Width - startX) };
+	const int endY{ std::min(startY + m_TileHeight, m_Height) };
+
+	const std::vector<ColorRGB>& frontBuffer{ m_Buffers[m_BackBufferIndex ^ 1] };
+	for (int py{ startY }; py < endY; ++py)
+	{
+		ResolveRow(&frontBuffer[startX + py * m_Width], m_pSurfacePixels + startX + py * m_SurfacePitch, count, startX, py);
+	}
+}
+
+void RenderTarget::CycleToneMapping()
+{
+	m_CurrentToneMapping = static_cast<ToneMapping>((static_cast<int>(m_CurrentToneMapping) + 1) % 3);
+}
+
+void RenderTarget::ResolveRow(const ColorRGB* pSource, uint32_t* pDestination, int count, int px, int py) const
+{
+	const float* pDitherRow{ g_DitherMatrix[py & 3] };
+	int i{};
+
+#ifdef SSE_PACK
+	const __m128 zero{ _mm_setzero_ps() };
+	const __m128 one{ _mm_set1_ps(1.f) };
+	const __m128 maxChannel{ _mm_set1_ps(255.f) };
+	const __m128 exposure{ _mm_set1_ps(m_Exposure) };
+	const __m128 tableScale{ _mm_set1_ps(static_cast<float>(m_SRGBTableSize - 1)) };
+
+	const __m128 acesA{ _mm_set1_ps(g_AcesA) };
+	const __m128 acesB{ _mm_set1_ps(g_AcesB) };
+	const __m128 acesC{ _mm_set1_ps(g_AcesC) };
+	const __m128 acesD{ _mm_set1_ps(g_AcesD) };
+	const __m128 acesE{ _mm_set1_ps(g_AcesE) };
+
+	const __m128i redShift{ _mm_cvtsi32_si128(static_cast<int>(m_RedShift)) };
+	const __m128i greenShift{ _mm_cvtsi32_si128(static_cast<int>(m_GreenShift)) };
+	const __m128i blueShift{ _mm_cvtsi32_si128(static_cast<int>(m_BlueShift)) };
+	const __m128i alpha{ _mm_set1_epi32(static_cast<int>(m_AlphaMask)) };
+
+	const auto aces = [&](__m128 x)
+	{
+		const __m128 numerator{ _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(acesA, x), acesB)) };
+		const __m128 denominator{ _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(acesC, x), acesD)), acesE) };
+		return _mm_div_ps(numerator, denominator);
+	};
+
+	//No gather in SSE2, the table lookups are done per lane
+	const auto encodeSRGB = [&](__m128 x)
+	{
+		alignas(16) int indices[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(indices), _mm_cvttps_epi32(_mm_mul_ps(x, tableScale)));
+		return _mm_setr_ps(m_SRGBTable[indices[0]], m_SRGBTable[indices[1]], m_SRGBTable[indices[2]], m_SRGBTable[indices[3]]);
+	};
+
+	//4 pixels at a time, same steps as ToneMap and Quantize below
+	for (; i + 4 <= count; i += 4)
+	{
+		const ColorRGB* pColors{ pSource + i };
+
+		__m128 r{ _mm_setr_ps(pColors[0].r, pColors[1].r, pColors[2].r, pColors[3].r) };
+		__m128 g{ _mm_setr_ps(pColors[0].g, pColors[1].g, pColors[2].g, pColors[3].g) };
+		__m128 b{ _mm_setr_ps(pColors[0].b, pColors[1].b, pColors[2].b, pColors[3].b) };
+
+		r = _mm_mul_ps(_mm_max_ps(r, zero), exposure);
+		g = _mm_mul_ps(_mm_max_ps(g, zero), exposure);
+		b = _mm_mul_ps(_mm_max_ps(b, zero), exposure);
+
+		switch (m_CurrentToneMapping)
+		{
+		case ToneMapping::MaxToOne:
+		{
+			const __m128 scale{ _mm_div_ps(one, _mm_max_ps(_mm_max_ps(r, g), _mm_max_ps(b, one))) };
+			r = _mm_mul_ps(r, scale);
+			g = _mm_mul_ps(g, scale);
+			b = _mm_mul_ps(b, scale);
+		}
+		break;
+		case ToneMapping::Reinhard:
+			r = _mm_div_ps(r, _mm_add_ps(r, one));
+			g = _mm_div_ps(g, _mm_add_ps(g, one));
+			b = _mm_div_ps(b, _mm_add_ps(b, one));
+			break;
+		case ToneMapping::ACES:
+			r = aces(r);
+			g = aces(g);
+			b = aces(b);
+			break;
+		}
+
+		r = _mm_min_ps(r, one);
+		g = _mm_min_ps(g, one);
+		b = _mm_min_ps(b, one);
+
+		if (m_SRGBEnabled)
+		{
+			r = encodeSRGB(r);
+			g = encodeSRGB(g);
+			b = encodeSRGB(b);
+		}
+		else
+		{
+			r = _mm_mul_ps(r, maxChannel);
+			g = _mm_mul_ps(g, maxChannel);
+			b = _mm_mul_ps(b, maxChannel);
+		}
+
+		if (m_DitheringEnabled)
+		{
+			const int ditherX{ (px + i) & 3 };
+			const __m128 dither{ _mm_setr_ps(pDitherRow[ditherX], pDitherRow[(ditherX + 1) & 3],
+				pDitherRow[(ditherX + 2) & 3], pDitherRow[(ditherX + 3) & 3]) };
+
+			r = _mm_min_ps(_mm_add_ps(r, dither), maxChannel);
+			g = _mm_min_ps(_mm_add_ps(g, dither), maxChannel);
+			b = _mm_min_ps(_mm_add_ps(b, dither), maxChannel);
+		}
+
+		const __m128i red{ _mm_cvttps_epi32(r) };
+		const __m128i green{ _mm_cvttps_epi32(g) };
+		const __m128i blue{ _mm_cvttps_epi32(b) };
+
+		const __m128i packed{ _mm_or_si128(
+			_mm_or_si128(_mm_sll_epi32(red, redShift), _mm_sll_epi32(green, greenShift)),
+			_mm_or_si128(_mm_sll_epi32(blue, blueShift), alpha)) };
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + i), packed);
+	}
+#endif // SSE_PACK
+
+	for (; i < count; ++i)
+	{
+		const ColorRGB color{ ToneMap(pSource[i]) };
+		const float dither{ m_DitheringEnabled ? pDitherRow[(px + i) & 3] : 0.f };
+
+		pDestination[i] =
+			(Quantize(color.r, dither) << m_RedShift) |
+			(Quantize(color.g, dither) << m_GreenShift) |
+			(Quantize(color.b, dither) << m_BlueShift) |
+			m_AlphaMask;
+	}
+}
+
+ColorRGB RenderTarget::ToneMap(const ColorRGB& color) const
+{
+	//Comparisons with NaN are false, so NaN clamps like in _mm_max_ps and _mm_min_ps: to 0 here, to 1 at the end
+	ColorRGB exposed{ color.r > 0.f ? color.r : 0.f, color.g > 0.f ? color.g : 0.f, color.b > 0.f ? color.b : 0.f };
+	exposed *= m_Exposure;
+
+	switch (m_CurrentToneMapping)
+	{
+	case ToneMapping::MaxToOne:
+		exposed.MaxToOne();
+		break;
+	case ToneMapping::Reinhard:
+		exposed = { exposed.r / (exposed.r + 1.f), exposed.g / (exposed.g + 1.f), exposed.b / (exposed.b + 1.f) };
+		break;
+	case ToneMapping::ACES:
+		exposed = { ACES(exposed.r), ACES(exposed.g), ACES(exposed.b) };
+		break;
+	}
+
+	return { exposed.r < 1.f ? exposed.r : 1.f, exposed.g < 1.f ? exposed.g : 1.f, exposed.b < 1.f ? exposed.b : 1.f };
+}
+
+uint32_t RenderTarget::Quantize(float value, float dither) const
+{
+	//Clamped again, converting NaN or anything outside [0, 1] to a table index would read out of bounds
+	const float clamped{ value > 0.f ? (value < 1.f ? value : 1.f) : 0.f };
+	const float encoded{ m_SRGBEnabled ? m_SRGBTable[static_cast<int>(clamped * (m_SRGBTableSize - 1))] : clamped * 255.f };
+	return static_cast<uint32_t>(std::min(encoded + dither, 255.f));
+}
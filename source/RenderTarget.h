@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+struct SDL_Surface;
+
+namespace dae
+{
+	//Double buffered linear HDR color buffer: the renderer writes the back buffer while the front buffer
+	//is presented. Resolving the front buffer runs the post pass per tile:
+	//exposure, tone mapping, optional sRGB encode and dithering, then packing into the surface format,
+	//which is read once at construction so the conversion never needs SDL_MapRGB.
+	//Changing the post settings only needs another resolve, nothing has to be traced again.
+	class RenderTarget final
+	{
+	public:
+		RenderTarget(SDL_Surface* pSurface);
+		~RenderTarget() = default;
+
+		RenderTarget(const RenderTarget&) = delete;
+		RenderTarget(RenderTarget&&) noexcept = delete;
+		RenderTarget& operator=(const RenderTarget&) = delete;
+		RenderTarget& operator=(RenderTarget&&) noexcept = delete;
+
+		void SetPixel(int px, int py, const ColorRGB& color) { m_Buffers[m_BackBufferIndex][px + py * m_Width] = color; }
+		const ColorRGB& GetPixel(int px, int py) const { return m_Buffers[m_BackBufferIndex][px + py * m_Width]; }
+		void SwapBuffers() { m_BackBufferIndex ^= 1; }
+
+		uint32_t GetNumTiles() const { return static_cast<uint32_t>(m_NumTilesX * m_NumTilesY); }
+		void ResolveTile(uint32_t tileIndex) const;
+
+		void CycleToneMapping();
+		void ToggleSRGB() { m_SRGBEnabled = !m_SRGBEnabled; }
+		void ToggleDithering() { m_DitheringEnabled = !m_DitheringEnabled; }
+		void SetExposure(float exposure) { m_Exposure = std::max(exposure, 0.f); }
+		float GetExposure() const { return m_Exposure; }
+
+		//Exposure and tone mapping as the resolve applies them, linear [0, 1] out
+		ColorRGB ToneMap(const ColorRGB& color) const;
+
+	private:
+		enum class ToneMapping
+		{
+			MaxToOne,
+			Reinhard,
+			ACES,
+		};
+
+		void ResolveRow(const ColorRGB* pSource, uint32_t* pDestination, int count, int px, int py) const;
+		uint32_t Quantize(float value, float dither) const;
+
+		ToneMapping m_CurrentToneMapping{ ToneMapping::MaxToOne };
+		float m_Exposure{ 1.f };
+		bool m_SRGBEnabled{ false };
+		bool m_DitheringEnabled{ false };
+
+		//Linear [0, 1] to sRGB encoded [0, 255]
+		static constexpr int m_SRGBTableSize{ 4096 };
+		std::vector<float> m_SRGBTable{};
+
+		//32 pixels of 4 bytes span two cache lines. SDL doesn't promise 64 byte aligned rows, so neighbouring
+		//tiles may still share the line at their edge, but never more than that one
+		static constexpr int m_TileWidth{ 32 };
+		static constexpr int m_TileHeight{ 8 };
+
+		uint32_t* m_pSurfacePixels{};
+		int m_SurfacePitch{};
+
+		int m_Width{};
+		int m_Height{};
+		int m_NumTilesX{};
+		int m_NumTilesY{};
+
+		uint32_t m_RedShift{};
+		uint32_t m_GreenShift{};
+		uint32_t m_BlueShift{};
+		uint32_t m_AlphaMask{};
+
+		std::vector<ColorRGB> m_Buffers[2]{};
+		int m_BackBufferIndex{};
+	};
+}
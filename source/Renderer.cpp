@@ -10,6 +10,13 @@
 #include "Material.h"
 #include "Scene.h"
 #include "Utils.h"
+#include "Profiler.h"
+#include "RayStats.h"
+#include "Arena.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <iterator>
 #include <thread>
 #include <future>//async stuff
 #include <ppl.h>//parrallel stuff
@@ -21,27 +28,161 @@ using namespace dae;
 //#define ASYNC
 #define PARALLEL_FOR
 
+namespace
+{
+	//Work done by this thread so far, only differences between two calls mean something
+	uint64_t GetTraversalCost()
+	{
+#ifdef RAY_STATS
+		return RayStats::GetThreadCount(RayCounter::BVHNodesVisited) + RayStats::GetThreadCount(RayCounter::TriangleTests);
+#else
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif // RAY_STATS
+	}
+
+	//Black - blue - cyan - green - yellow - red, log scale so cheap regions don't all end up black
+	ColorRGB GetHeatMapColor(uint32_t cost, uint32_t maxCost)
+	{
+		static const ColorRGB colors[]{ {0.f, 0.f, 0.f}, {0.f, 0.f, 1.f}, {0.f, 1.f, 1.f}, {0.f, 1.f, 0.f}, {1.f, 1.f, 0.f}, {1.f, 0.f, 0.f} };
+		constexpr int numSegments{ static_cast<int>(std::size(colors)) - 1 };
+
+		const float t{ std::clamp(log1pf(static_cast<float>(cost)) / log1pf(static_cast<float>(std::max(maxCost, 1u))), 0.f, 1.f) };
+		const int segment{ std::min(static_cast<int>(t * numSegments), numSegments - 1) };
+		const float weight{ t * numSegments - segment };
+
+		return ColorRGB::Lerp(colors[segment], colors[segment + 1], weight);
+	}
+}
+
 Renderer::Renderer(SDL_Window* pWindow) :
-	m_pWindow(pWindow),
-	m_pBuffer(SDL_GetWindowSurface(pWindow))
+	Renderer(SDL_GetWindowSurface(pWindow))
+{
+	m_pWindow = pWindow;
+}
+
+Renderer::Renderer(SDL_Surface* pBuffer) :
+	m_pBuffer(pBuffer),
+	m_RenderTarget(m_pBuffer)
 {
 	//Initialize
-	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
-	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	m_Width = m_pBuffer->w;
+	m_Height = m_pBuffer->h;
 	m_WidthDivision = 1.f / m_Width;
 	m_HeightDivision = 1.f / m_Height;
 	m_AR = m_Width / static_cast<float>(m_Height);
+
+	m_AccumulationBuffer.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_ScaledBuffer.resize(static_cast<size_t>(m_Width) * m_Height);
+
+	m_NumTilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	const int numTilesY{ (m_Height + m_TileSize - 1) / m_TileSize };
+	m_TileNeedsSamples.resize(static_cast<size_t>(m_NumTilesX) * numTilesY);
+
+	m_ReprojectionCache.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_PreviousReprojectionCache.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_ReprojectedDepth.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_ReprojectedSource.resize(static_cast<size_t>(m_Width) * m_Height);
+
+	m_CheckerboardBuffer.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_CostBuffer.resize(static_cast<size_t>(m_Width) * m_Height);
+}
+
+void Renderer::Render(Scene* pScene)
+{
+	BeginRender(pScene);
+	EndRender();
+	Present();
+}
+
+void Renderer::BeginRender(Scene* pScene)
+{
+	assert(!m_FrameInFlight.valid() && "EndRender wasn't called for the previous frame");
+
+	m_FrameInFlight = std::async(std::launch::async, [this, pScene] { TraceFrame(pScene); });
+}
+
+void Renderer::EndRender()
+{
+	if (!m_FrameInFlight.valid())
+		return;
+
+	m_FrameInFlight.get();
+
+	//A converged frame traces nothing, the front buffer still holds it
+	if (m_HasNewFrame)
+		m_RenderTarget.SwapBuffers();
+}
+
+void Renderer::Present() const
+{
+	PROFILE_SCOPE(ProfileStage::Present);
+
+	ResolveRenderTarget();
+
+	//Update SDL Surface
+	if (m_pWindow)
+		SDL_UpdateWindowSurface(m_pWindow);
 }
 
-void Renderer::Render(Scene* pScene) const
+void Renderer::TraceFrame(Scene* pScene)
 {
+	PROFILE_SCOPE(ProfileStage::Trace);
+
+	pScene->UpdateLightSampling();
+	pScene->UpdateLODs();
+
 	Camera& camera = pScene->GetCamera();
 	camera.CalculateCameraToWorld();
 
 	auto& materials = pScene->GetMaterials();
 	auto& lights = pScene->GetLights();
 
-	const uint32_t numPixels = m_Width * m_Height;
+	const uint64_t frameStart{ SDL_GetPerformanceCounter() };
+
+	//An animated scene invalidates accumulated samples like a moving camera does, and the reprojected
+	//points no longer lie on the geometry that moved
+	const bool hasSceneChanged{ pScene->GetVersion() != m_LastSceneVersion };
+	m_LastSceneVersion = pScene->GetVersion();
+	if (hasSceneChanged)
+		m_HasReprojectionCache = false;
+
+	//Not ResetAccumulation, the checkerboard history is what the frames of a moving camera build on
+	m_IsCameraMoving = HasCameraMoved(camera) || hasSceneChanged;
+	if (m_IsCameraMoving)
+		m_AccumulatedSamples = 0;
+
+	//Image has converged, nothing left to trace until something changes
+	m_HasNewFrame = !(m_ProgressiveEnabled && !m_IsCameraMoving && m_AccumulatedSamples >= m_TargetSampleCount);
+	if (!m_HasNewFrame)
+		return;
+
+	++m_FrameIndex;
+
+	//Only interactive frames are reprojected or scaled, accumulation always happens at full resolution
+	const bool isInteractiveFrame{ !m_ProgressiveEnabled || m_IsCameraMoving };
+	m_IsReprojectedFrame = isInteractiveFrame && m_CurrentInteractiveMode == InteractiveMode::Reprojection;
+	m_IsCheckerboardFrame = isInteractiveFrame && m_CurrentInteractiveMode == InteractiveMode::Checkerboard;
+	m_IsScaledFrame = isInteractiveFrame && m_CurrentInteractiveMode == InteractiveMode::DynamicResolution;
+
+	//Half-frames from before other frames were traced in between are too old to pass for the last frame
+	if (!m_IsCheckerboardFrame)
+		m_HasCheckerboardHistory = false;
+
+	if (m_IsReprojectedFrame)
+		ReprojectPreviousFrame(camera);
+
+	if (m_IsScaledFrame)
+	{
+		m_ScaledWidth = std::max(1, static_cast<int>(m_Width * m_RenderScale + 0.5f));
+		m_ScaledHeight = std::max(1, static_cast<int>(m_Height * m_RenderScale + 0.5f));
+	}
+
+	uint32_t numPixels = m_Width * m_Height;
+	if (m_IsScaledFrame)
+		numPixels = m_ScaledWidth * m_ScaledHeight;
+	else if (m_IsCheckerboardFrame)
+		numPixels = ((m_Width + 1) / 2) * m_Height;
 
 
 
@@ -112,23 +253,138 @@ void Renderer::Render(Scene* pScene) const
 
 #endif // defined(ASYNC)
 
+	if (m_ProgressiveEnabled && !m_IsCameraMoving)
+	{
+		++m_AccumulatedSamples;
+
+		//Every pixel has one sample now, decide where the remaining samples go
+		if (IsAdaptiveSamplingActive() && m_AccumulatedSamples == 1)
+			UpdateAdaptiveTiles();
+	}
+
+	if (m_IsScaledFrame)
+		UpscaleToBuffer();
+
+	if (m_IsCheckerboardFrame)
+		ReconstructCheckerboard();
+
+	if (m_IsReprojectedFrame)
+	{
+		m_ReprojectionCache.swap(m_PreviousReprojectionCache);
+		m_HasReprojectionCache = true;
+	}
 
 	//@END
-	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+	m_LastTraceTime = static_cast<float>(SDL_GetPerformanceCounter() - frameStart) /
+		static_cast<float>(SDL_GetPerformanceFrequency());
+
+	if (m_IsScaledFrame)
+		UpdateRenderScale(m_LastTraceTime);
+
+	if (m_CurrentLightingMode == LightingMode::TraversalCost)
+	{
+		m_CostScale = std::max(m_MaxPixelCost.exchange(0, std::memory_order_relaxed), 1u);
+		m_HasCostMap = true;
+	}
 }
 
 
-void Renderer::RenderPixel(Scene* scene, uint32_t pixelIndex, const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials) const
+void Renderer::RenderPixel(Scene* scene, uint32_t pixelIndex, const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials)
 {
-	float pxc, pyc, cx, cy;
+	if (m_IsScaledFrame)
+	{
+		//pixelIndex addresses the scaled buffer, trace its center in full resolution pixel space
+		const int sx = pixelIndex % m_ScaledWidth;
+		const int sy = pixelIndex / m_ScaledWidth;
+
+		const float pxc{ (sx + 0.5f) * m_Width / static_cast<float>(m_ScaledWidth) };
+		const float pyc{ (sy + 0.5f) * m_Height / static_cast<float>(m_ScaledHeight) };
+
+		m_ScaledBuffer[pixelIndex] = TracePixel(scene, pxc, pyc, camera, lights, materials);
+		return;
+	}
 
+	if (m_IsCheckerboardFrame)
+	{
+		//pixelIndex addresses only this frame's half of the checkerboard
+		const int halfWidth{ (m_Width + 1) / 2 };
+		const int py = pixelIndex / halfWidth;
+		const int px = 2 * (pixelIndex % halfWidth) + ((py + m_FrameIndex) & 1);
+		if (px >= m_Width)
+			return;
+
+		m_CheckerboardBuffer[px + py * m_Width] = TracePixel(scene, px + 0.5f, py + 0.5f, camera, lights, materials);
+		return;
+	}
 
 	const int px = pixelIndex % m_Width;
 	const int py = pixelIndex / m_Width;
 
-	pxc = px + 0.5f;
-	pyc = py + 0.5f;
+	if (m_IsReprojectedFrame)
+	{
+		CachedSample& cachedSample{ m_ReprojectionCache[pixelIndex] };
+
+		if (CanReusePixel(px, py))
+		{
+			cachedSample = m_PreviousReprojectionCache[m_ReprojectedSource[pixelIndex]];
+		}
+		else
+		{
+			HitRecord closestHit{};
+			cachedSample.color = TracePixel(scene, px + 0.5f, py + 0.5f, camera, lights, materials, &closestHit);
+			cachedSample.position = closestHit.origin;
+			cachedSample.materialIndex = closestHit.materialIndex;
+			cachedSample.didHit = closestHit.didHit;
+		}
+
+		WritePixel(px, py, cachedSample.color);
+		return;
+	}
+
+	if (!m_ProgressiveEnabled || m_IsCameraMoving)
+	{
+		WritePixel(px, py, TracePixel(scene, px + 0.5f, py + 0.5f, camera, lights, materials));
+		return;
+	}
+
+	//Flat tiles are done after their first sample, only copy it to this frame's buffer
+	if (IsAdaptiveSamplingActive() && m_AccumulatedSamples > 0 &&
+		!m_TileNeedsSamples[(px / m_TileSize) + (py / m_TileSize) * m_NumTilesX])
+	{
+		WritePixel(px, py, m_AccumulationBuffer[pixelIndex]);
+		return;
+	}
+
+	//Camera is still, add one stratified sample to the running sum.
+	//Strata are visited diagonally (stride gridSize + 1 is coprime with gridSize^2) from a per-pixel start,
+	//so any prefix of the samples is spread over the pixel
+	const int gridSize{ std::max(1, static_cast<int>(sqrtf(static_cast<float>(m_TargetSampleCount)))) };
+	const uint32_t numStrata{ static_cast<uint32_t>(gridSize * gridSize) };
+	const uint32_t stratum{ (Hash(pixelIndex) + m_AccumulatedSamples * (gridSize + 1)) % numStrata };
+
+	uint32_t seed{ Hash(pixelIndex * m_TargetSampleCount + m_AccumulatedSamples) };
+	const float jitterX{ ((stratum % gridSize) + RandomFloat(seed)) / gridSize };
+	const float jitterY{ ((stratum / gridSize) + RandomFloat(seed)) / gridSize };
+
+	const ColorRGB sample{ TracePixel(scene, px + jitterX, py + jitterY, camera, lights, materials) };
+
+	ColorRGB& accumulatedColor{ m_AccumulationBuffer[pixelIndex] };
+	if (m_AccumulatedSamples == 0)
+		accumulatedColor = sample;
+	else
+		accumulatedColor += sample;
+
+	ColorRGB averageColor{ accumulatedColor };
+	averageColor /= static_cast<float>(m_AccumulatedSamples + 1);
+	WritePixel(px, py, averageColor);
+}
+
+ColorRGB Renderer::TracePixel(Scene* scene, float pxc, float pyc, const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials, HitRecord* pClosestHit)
+{
+	const bool isCostView{ m_CurrentLightingMode == LightingMode::TraversalCost };
+	const uint64_t costStart{ isCostView ? GetTraversalCost() : 0 };
+
+	float cx, cy;
 
 	cx = ((2 * pxc * m_WidthDivision) - 1) * m_AR * camera.cameraFOV;
 	cy = (1 - ((2 * pyc) * m_HeightDivision)) * camera.cameraFOV;
@@ -154,7 +410,10 @@ void Renderer::RenderPixel(Scene* scene, uint32_t pixelIndex, const Camera& came
 
 	//HitRecord containing more info about possible hit
 	HitRecord closestHit{};
-	scene->GetClosestHit(viewRay, closestHit);
+	{
+		PROFILE_SCOPE(ProfileStage::PrimaryRays);
+		scene->GetClosestHit(viewRay, closestHit);
+	}
 
 	//Testing
 	//Sphere testSphere{ {0.f,0.f,100.f}, 50.f, 0 };
@@ -179,62 +438,417 @@ void Renderer::RenderPixel(Scene* scene, uint32_t pixelIndex, const Camera& came
 
 		const Vector3 hitPoint = closestHit.origin + closestHit.normal * 0.05f;
 
-		for (auto& light : lights)
-		{
-			Vector3 lightDirection = LightUtils::GetDirectionToLight(light, hitPoint);
+		//Lights facing the hit that could add a visible amount.
+		//The BRDF is left out of the bound, so modes that ignore radiance keep every light
+		const bool isRadianceBounded{ m_CurrentLightingMode == LightingMode::Radiance ||
+			m_CurrentLightingMode == LightingMode::Combined || m_CurrentLightingMode == LightingMode::TraversalCost };
 
-			const float lightDistance{ lightDirection.Normalize() };
+		//Both lists live in this thread's scratch arena until the pixel is done, a single reserve each
+		thread_local Arena scratchArena{ 64 << 10 };
+		const ArenaScope scratchScope{ scratchArena };
+		std::pmr::vector<LightCandidate> candidates{ &scratchArena };
+		std::pmr::vector<uint32_t> lightIndices{ &scratchArena };
+		candidates.reserve(lights.size());
+		lightIndices.reserve(lights.size());
 
-			if (m_ShadowsEnabled)
-			{
-				const Ray lightRay = Ray{ hitPoint, lightDirection,  0.0001f, lightDistance };
+		const LightTree& lightTree{ scene->GetLightTree() };
+		const float cullThreshold{ isRadianceBounded ? m_LightCullThreshold : 0.f };
 
-				if (scene->DoesHit(lightRay))
-				{
-					continue;
+		if (m_CurrentLightSampling != LightSampling::Exhaustive)
+		{
+			//Unbounded lights can't be picked by importance, those are always evaluated
+			for (const uint32_t lightIdx : lightTree.GetUnboundedLights())
+				AddLightCandidate(lights[lightIdx], hitPoint, closestHit, cullThreshold, 1.f, candidates);
+
+			//Sample positions differ per frame, so accumulation averages the picks out
+			const AliasTable& aliasTable{ scene->GetLightAliasTable() };
+			uint32_t seed{ Hash(std::bit_cast<uint32_t>(pxc) ^ Hash(std::bit_cast<uint32_t>(pyc) ^ Hash(m_FrameIndex))) };
+			for (int sampleIdx{}; sampleIdx < m_NumLightSamples; ++sampleIdx)
+			{
+				float pdf{};
+				const int lightIdx{ m_CurrentLightSampling == LightSampling::LightTree ?
+					lightTree.SampleLight(closestHit.origin, closestHit.normal, RandomFloat(seed), pdf) :
+					aliasTable.Sample(RandomFloat(seed), pdf) };
+				if (lightIdx < 0)
+					break;
 
-				}
+				//No threshold here, culling a sampled light would darken the estimate
+				AddLightCandidate(lights[lightIdx], hitPoint, closestHit, 0.f, 1.f / (pdf * m_NumLightSamples), candidates);
 			}
+		}
+		else
+		{
+			lightTree.GatherLights(closestHit.origin, closestHit.normal, cullThreshold, lightIndices);
+			for (const uint32_t lightIdx : lightIndices)
+				AddLightCandidate(lights[lightIdx], hitPoint, closestHit, cullThreshold, 1.f, candidates);
+		}
+
+		for (const LightCandidate& candidate : candidates)
+		{
+			if (m_ShadowsEnabled && IsLightOccluded(scene, hitPoint, candidate.direction, candidate.distance, candidate.pLight - lights.data()))
+				continue;
+
+			PROFILE_SCOPE(ProfileStage::Shading);
+			finalColor += ShadeLight(*candidate.pLight, closestHit, candidate.direction, candidate.observedArea, viewRay.direction, materials) * candidate.weight;
+		}
+	}
+
+	if (isCostView)
+	{
+		const uint32_t cost{ static_cast<uint32_t>(GetTraversalCost() - costStart) };
+
+		//Scaled frames spread fewer samples over the screen, those simply leave gaps in the dump
+		const int px{ std::min(static_cast<int>(pxc), m_Width - 1) };
+		const int py{ std::min(static_cast<int>(pyc), m_Height - 1) };
+		m_CostBuffer[px + py * m_Width] = cost;
+
+		uint32_t maxCost{ m_MaxPixelCost.load(std::memory_order_relaxed) };
+		while (cost > maxCost && !m_MaxPixelCost.compare_exchange_weak(maxCost, cost, std::memory_order_relaxed))
+		{
+		}
+
+		finalColor = GetHeatMapColor(cost, m_CostScale);
+	}
+
+	if (pClosestHit)
+		*pClosestHit = closestHit;
+
+	return finalColor;
+}
+
+void Renderer::AddLightCandidate(const Light& light, const Vector3& hitPoint, const HitRecord& closestHit, float threshold, float weight,
+	std::pmr::vector<LightCandidate>& candidates) const
+{
+	Vector3 lightDirection = LightUtils::GetDirectionToLight(light, hitPoint);
+	float lightDistance{ lightDirection.Normalize() };
+
+	//A directional light has no position, its shadow rays run through the whole scene
+	if (light.type == LightType::Directional)
+		lightDistance = FLT_MAX;
 
-			const float observedArea{ Vector3::Dot(closestHit.normal, lightDirection)};
-			if (observedArea > 0)
+	//Behind the surface, no need for a shadow ray
+	const float observedArea{ Vector3::Dot(closestHit.normal, lightDirection) };
+	if (observedArea <= 0)
+		return;
+
+	const float contributionBound{ LightUtils::GetRadiance(light, closestHit.origin).GetLuminance() * observedArea * weight };
+	if (contributionBound < threshold)
+		return;
+
+	candidates.push_back(LightCandidate{ &light, lightDirection, lightDistance, observedArea, weight });
+}
+
+bool Renderer::IsLightOccluded(const Scene* scene, const Vector3& hitPoint, const Vector3& lightDirection, float lightDistance, size_t lightIdx) const
+{
+	PROFILE_SCOPE(ProfileStage::ShadowRays);
+
+	const Ray lightRay = Ray{ hitPoint, lightDirection,  0.0001f, lightDistance };
+	if (!m_OccluderCacheEnabled)
+	{
+		ShadowOccluder occluder{};
+		return scene->IsLightOccluded(lightRay, lightIdx, occluder);
+	}
+
+	//A thread traces its pixels in runs, so the previous ray towards a light is usually a neighbour's.
+	//A cached occluder is only ever a hint, whatever it hits really blocks the ray
+	thread_local std::vector<ShadowOccluder> occluderCache{};
+	thread_local const Scene* pCachedScene{};
+	if (pCachedScene != scene)
+	{
+		occluderCache.clear();
+		pCachedScene = scene;
+	}
+	if (lightIdx >= occluderCache.size())
+		occluderCache.resize(lightIdx + 1);
+
+	return scene->IsLightOccluded(lightRay, lightIdx, occluderCache[lightIdx]);
+}
+
+ColorRGB Renderer::ShadeLight(const Light& light, const HitRecord& closestHit, const Vector3& lightDirection, float observedArea,
+	const Vector3& viewDirection, const std::vector<Material*>& materials) const
+{
+	switch (m_CurrentLightingMode)
+	{
+	case LightingMode::ObservedArea:
+		return ColorRGB{ observedArea, observedArea, observedArea };
+	case LightingMode::Radiance:
+		return LightUtils::GetRadiance(light, closestHit.origin);
+	case LightingMode::BRDF:
+		return materials[closestHit.materialIndex]->
+			Shade(closestHit, lightDirection, viewDirection);
+	case LightingMode::Combined:
+	case LightingMode::TraversalCost:
+	default:
+		return materials[closestHit.materialIndex]->
+			Shade(closestHit, lightDirection, viewDirection) *
+			LightUtils::GetRadiance(light, closestHit.origin) *
+			observedArea;
+	}
+}
+
+void Renderer::ResolveRenderTarget() const
+{
+	//Convert the float buffer to the surface format, one tile per task
+	const uint32_t numTiles{ m_RenderTarget.GetNumTiles() };
+
+#if defined(PARALLEL_FOR)
+	concurrency::parallel_for(0u, numTiles,
+		[this](uint32_t tileIndex)
+		{
+			m_RenderTarget.ResolveTile(tileIndex);
+		});
+#else
+	for (uint32_t tileIndex{}; tileIndex < numTiles; ++tileIndex)
+	{
+		m_RenderTarget.ResolveTile(tileIndex);
+	}
+#endif // defined(PARALLEL_FOR)
+}
+
+void Renderer::UpdateRenderScale(float frameTime)
+{
+	//Traced pixels scale with the square of the render scale, aim a bit under the budget
+	//and only move halfway towards the new scale to avoid oscillating between frames
+	constexpr float headroom{ 0.9f };
+	const float idealScale{ m_RenderScale * sqrtf(headroom * m_TargetFrameTime / std::max(frameTime, FLT_EPSILON)) };
+
+	m_RenderScale = std::clamp(Lerpf(m_RenderScale, idealScale, 0.5f), m_MinRenderScale, 1.f);
+}
+
+void Renderer::UpscaleToBuffer()
+{
+	const float scaleX{ m_ScaledWidth / static_cast<float>(m_Width) };
+	const float scaleY{ m_ScaledHeight / static_cast<float>(m_Height) };
+
+	const auto upscaleRow = [=, this](int py)
+	{
+		const float sy{ std::clamp((py + 0.5f) * scaleY - 0.5f, 0.f, static_cast<float>(m_ScaledHeight - 1)) };
+		const int y0{ static_cast<int>(sy) };
+		const int y1{ std::min(y0 + 1, m_ScaledHeight - 1) };
+		const float fy{ sy - y0 };
+
+		for (int px{}; px < m_Width; ++px)
+		{
+			const float sx{ std::clamp((px + 0.5f) * scaleX - 0.5f, 0.f, static_cast<float>(m_ScaledWidth - 1)) };
+			const int x0{ static_cast<int>(sx) };
+			const int x1{ std::min(x0 + 1, m_ScaledWidth - 1) };
+			const float fx{ sx - x0 };
+
+			const ColorRGB top{ ColorRGB::Lerp(m_ScaledBuffer[x0 + y0 * m_ScaledWidth], m_ScaledBuffer[x1 + y0 * m_ScaledWidth], fx) };
+			const ColorRGB bottom{ ColorRGB::Lerp(m_ScaledBuffer[x0 + y1 * m_ScaledWidth], m_ScaledBuffer[x1 + y1 * m_ScaledWidth], fx) };
+
+			WritePixel(px, py, ColorRGB::Lerp(top, bottom, fy));
+		}
+	};
+
+#if defined(PARALLEL_FOR)
+	concurrency::parallel_for(0, m_Height, upscaleRow);
+#else
+	for (int py{}; py < m_Height; ++py)
+	{
+		upscaleRow(py);
+	}
+#endif // defined(PARALLEL_FOR)
+}
+
+void Renderer::UpdateAdaptiveTiles()
+{
+	std::fill(m_TileNeedsSamples.begin(), m_TileNeedsSamples.end(), uint8_t{ 0 });
+
+	//Displayed luminance, through the selected tone mapping and exposure, so overexposed areas
+	//that all clip to white count as flat
+	const auto getLuminance = [this](int px, int py)
+	{
+		return m_RenderTarget.ToneMap(m_AccumulationBuffer[px + py * m_Width]).GetLuminance();
+	};
+
+	const auto flagTile = [this](int px, int py)
+	{
+		m_TileNeedsSamples[(px / m_TileSize) + (py / m_TileSize) * m_NumTilesX] = 1;
+	};
+
+	//Compare every pixel with its right and bottom neighbour, a contrast above the threshold
+	//marks an edge or highlight and both tiles it touches get the remaining samples
+	for (int py{}; py < m_Height; ++py)
+	{
+		for (int px{}; px < m_Width; ++px)
+		{
+			const float luminance{ getLuminance(px, py) };
+
+			const int neighbours[2][2]{ { px + 1, py }, { px, py + 1 } };
+			for (const auto& neighbour : neighbours)
 			{
-				switch (m_CurrentLightingMode)
+				if (neighbour[0] >= m_Width || neighbour[1] >= m_Height)
+					continue;
+
+				const float neighbourLuminance{ getLuminance(neighbour[0], neighbour[1]) };
+				const float contrast{ abs(luminance - neighbourLuminance) /
+					std::max(luminance + neighbourLuminance, FLT_EPSILON) };
+
+				if (contrast > m_ContrastThreshold)
 				{
-				case LightingMode::ObservedArea:
-					finalColor += ColorRGB{ observedArea, observedArea, observedArea };
-					break;
-				case LightingMode::Radiance:
-					finalColor += LightUtils::GetRadiance(light, closestHit.origin);
-					break;
-				case LightingMode::BRDF:
-					finalColor += materials[closestHit.materialIndex]->
-						Shade(closestHit, lightDirection, viewRay.direction);
-					break;
-				case LightingMode::Combined:
-					finalColor += materials[closestHit.materialIndex]->
-						Shade(closestHit, lightDirection, viewRay.direction) *
-						LightUtils::GetRadiance(light, closestHit.origin) *
-						observedArea;
+					flagTile(px, py);
+					flagTile(neighbour[0], neighbour[1]);
 				}
 			}
-		
+		}
+	}
+}
+
+void Renderer::ReprojectPreviousFrame(const Camera& camera)
+{
+	std::fill(m_ReprojectedDepth.begin(), m_ReprojectedDepth.end(), FLT_MAX);
+	std::fill(m_ReprojectedSource.begin(), m_ReprojectedSource.end(), m_InvalidSource);
 
+	if (!m_HasReprojectionCache)
+		return;
+
+	//cameraToWorld is orthonormal, so world to camera is a dot product with each axis
+	const Vector3 cameraRight{ camera.cameraToWorld.GetAxisX() };
+	const Vector3 cameraUp{ camera.cameraToWorld.GetAxisY() };
+	const Vector3 cameraForward{ camera.cameraToWorld.GetAxisZ() };
+	const Vector3 cameraOrigin{ camera.cameraToWorld.GetTranslation() };
+
+	//Scatter every cached hit to the pixel it lands on now, the closest one wins
+	const uint32_t numPixels{ static_cast<uint32_t>(m_Width * m_Height) };
+	for (uint32_t sourceIndex{}; sourceIndex < numPixels; ++sourceIndex)
+	{
+		const CachedSample& cachedSample{ m_PreviousReprojectionCache[sourceIndex] };
+		if (!cachedSample.didHit)
+			continue;
+
+		const Vector3 toSample{ cachedSample.position - cameraOrigin };
+		const float depth{ Vector3::Dot(toSample, cameraForward) };
+		if (depth <= 0.f)
+			continue;
+
+		//Inverse of the ray setup in TracePixel
+		const float cx{ Vector3::Dot(toSample, cameraRight) / depth };
+		const float cy{ Vector3::Dot(toSample, cameraUp) / depth };
+
+		const float pxc{ (cx / (m_AR * camera.cameraFOV) + 1.f) * 0.5f * m_Width };
+		const float pyc{ (1.f - cy / camera.cameraFOV) * 0.5f * m_Height };
+		if (pxc < 0.f || pyc < 0.f || pxc >= m_Width || pyc >= m_Height)
+			continue;
+
+		const uint32_t targetIndex{ static_cast<uint32_t>(pxc) + static_cast<uint32_t>(pyc) * m_Width };
+		if (depth < m_ReprojectedDepth[targetIndex])
+		{
+			m_ReprojectedDepth[targetIndex] = depth;
+			m_ReprojectedSource[targetIndex] = sourceIndex;
 		}
+	}
+}
+
+bool Renderer::CanReusePixel(int px, int py) const
+{
+	const uint32_t pixelIndex{ static_cast<uint32_t>(px + py * m_Width) };
 
+	//Rotating refresh, keeps view dependent shading and moving objects from going stale
+	if ((Hash(pixelIndex) + m_FrameIndex) % m_RefreshInterval == 0)
+		return false;
 
+	const uint32_t source{ m_ReprojectedSource[pixelIndex] };
+	if (source == m_InvalidSource)
+		return false;
+
+	//Disocclusions and silhouettes show up as holes or material changes next to the pixel
+	const unsigned char materialIndex{ m_PreviousReprojectionCache[source].materialIndex };
+	const int neighbours[4][2]{ { px - 1, py }, { px + 1, py }, { px, py - 1 }, { px, py + 1 } };
+	for (const auto& neighbour : neighbours)
+	{
+		if (neighbour[0] < 0 || neighbour[1] < 0 || neighbour[0] >= m_Width || neighbour[1] >= m_Height)
+			continue;
+
+		const uint32_t neighbourSource{ m_ReprojectedSource[neighbour[0] + neighbour[1] * m_Width] };
+		if (neighbourSource == m_InvalidSource ||
+			m_PreviousReprojectionCache[neighbourSource].materialIndex != materialIndex)
+			return false;
 	}
 
-	//Update Color in Buffer
-	finalColor.MaxToOne();
+	return true;
+}
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+void Renderer::ReconstructCheckerboard()
+{
+	const auto reconstructRow = [this](int py)
+	{
+		for (int px{}; px < m_Width; ++px)
+		{
+			const ColorRGB& color{ m_CheckerboardBuffer[px + py * m_Width] };
+
+			if (((px + py + m_FrameIndex) & 1) == 0)
+			{
+				WritePixel(px, py, color);
+				continue;
+			}
 
+			//All four neighbours were traced this frame
+			ColorRGB neighbourMin{ FLT_MAX, FLT_MAX, FLT_MAX };
+			ColorRGB neighbourMax{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			ColorRGB neighbourSum{};
+			int numNeighbours{};
 
+			const int neighbours[4][2]{ { px - 1, py }, { px + 1, py }, { px, py - 1 }, { px, py + 1 } };
+			for (const auto& neighbour : neighbours)
+			{
+				if (neighbour[0] < 0 || neighbour[1] < 0 || neighbour[0] >= m_Width || neighbour[1] >= m_Height)
+					continue;
+
+				const ColorRGB& neighbourColor{ m_CheckerboardBuffer[neighbour[0] + neighbour[1] * m_Width] };
+				neighbourMin = { std::min(neighbourMin.r, neighbourColor.r), std::min(neighbourMin.g, neighbourColor.g), std::min(neighbourMin.b, neighbourColor.b) };
+				neighbourMax = { std::max(neighbourMax.r, neighbourColor.r), std::max(neighbourMax.g, neighbourColor.g), std::max(neighbourMax.b, neighbourColor.b) };
+				neighbourSum += neighbourColor;
+				++numNeighbours;
+			}
+
+			ColorRGB reconstructed{};
+			if (m_HasCheckerboardHistory)
+			{
+				//Last frame's value, clamped so it can't drag in colors that are no longer around it
+				reconstructed = {
+					std::clamp(color.r, neighbourMin.r, neighbourMax.r),
+					std::clamp(color.g, neighbourMin.g, neighbourMax.g),
+					std::clamp(color.b, neighbourMin.b, neighbourMax.b) };
+			}
+			else
+			{
+				reconstructed = neighbourSum;
+				reconstructed /= static_cast<float>(numNeighbours);
+			}
 
+			WritePixel(px, py, reconstructed);
+		}
+	};
+
+#if defined(PARALLEL_FOR)
+	concurrency::parallel_for(0, m_Height, reconstructRow);
+#else
+	for (int py{}; py < m_Height; ++py)
+	{
+		reconstructRow(py);
+	}
+#endif // defined(PARALLEL_FOR)
+
+	m_HasCheckerboardHistory = true;
+}
+
+bool Renderer::HasCameraMoved(const Camera& camera)
+{
+	const bool hasMoved{
+		!AreEqual(camera.origin.x, m_LastCameraOrigin.x) ||
+		!AreEqual(camera.origin.y, m_LastCameraOrigin.y) ||
+		!AreEqual(camera.origin.z, m_LastCameraOrigin.z) ||
+		!AreEqual(camera.forward.x, m_LastCameraForward.x) ||
+		!AreEqual(camera.forward.y, m_LastCameraForward.y) ||
+		!AreEqual(camera.forward.z, m_LastCameraForward.z) ||
+		!AreEqual(camera.fovAngle, m_LastCameraFOV) };
+
+	m_LastCameraOrigin = camera.origin;
+	m_LastCameraForward = camera.forward;
+	m_LastCameraFOV = camera.fovAngle;
+
+	return hasMoved;
 }
 
 bool Renderer::SaveBufferToImage() const
@@ -242,7 +856,61 @@ bool Renderer::SaveBufferToImage() const
 	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
 }
 
+bool Renderer::SaveCostMapToImage() const
+{
+	if (!m_HasCostMap)
+		return true;
+
+	SDL_Surface* pCostMap{ SDL_CreateRGBSurfaceWithFormat(0, m_Width, m_Height, 32, SDL_PIXELFORMAT_RGB888) };
+	if (!pCostMap)
+		return true;
+
+	//Normalized against this frame only, so dumps of different viewpoints aren't comparable by colour
+	const uint32_t maxCost{ *std::max_element(m_CostBuffer.begin(), m_CostBuffer.end()) };
+
+	uint32_t* pPixels{ static_cast<uint32_t*>(pCostMap->pixels) };
+	for (int py{}; py < m_Height; ++py)
+	{
+		for (int px{}; px < m_Width; ++px)
+		{
+			const ColorRGB color{ GetHeatMapColor(m_CostBuffer[px + py * m_Width], maxCost) };
+
+			pPixels[px + py * (pCostMap->pitch / 4)] = SDL_MapRGB(pCostMap->format,
+				static_cast<uint8_t>(color.r * 255),
+				static_cast<uint8_t>(color.g * 255),
+				static_cast<uint8_t>(color.b * 255));
+		}
+	}
+
+	const bool hasFailed{ SDL_SaveBMP(pCostMap, "RayTracing_CostMap.bmp") != 0 };
+	SDL_FreeSurface(pCostMap);
+
+	std::cout << "**COSTMAP** max cost per pixel = " << maxCost
+#ifdef RAY_STATS
+		<< " (bvh nodes + triangle tests)" << std::endl;
+#else
+		<< " ns" << std::endl;
+#endif // RAY_STATS
+
+	return hasFailed;
+}
+
 void dae::Renderer::CycleLightingMode()
 {
-	m_CurrentLightingMode = static_cast<LightingMode>((static_cast<int>(m_CurrentLightingMode) + 1) % 4);
+	m_CurrentLightingMode = static_cast<LightingMode>((static_cast<int>(m_CurrentLightingMode) + 1) % 5);
+	ResetAccumulation();
+	ResetHistory();
+}
+
+void dae::Renderer::CycleLightSampling()
+{
+	m_CurrentLightSampling = static_cast<LightSampling>((static_cast<int>(m_CurrentLightSampling) + 1) % 3);
+	ResetAccumulation();
+	ResetHistory();
+}
+
+void dae::Renderer::CycleInteractiveMode()
+{
+	m_CurrentInteractiveMode = static_cast<InteractiveMode>((static_cast<int>(m_CurrentInteractiveMode) + 1) % 4);
+	ResetHistory();
 }
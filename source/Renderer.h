@@ -1,8 +1,14 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <future>
+#include <memory_resource>
 #include <vector>
 
+#include "Math.h"
+#include "RenderTarget.h"
+
 struct SDL_Window;
 struct SDL_Surface;
 
@@ -12,6 +18,7 @@ namespace dae
 
 	struct Camera;
 	struct Light;
+	struct HitRecord;
 
 	class Scene;
 	class Material;
@@ -19,7 +26,18 @@ namespace dae
 	class Renderer final
 	{
 	public:
+		//How frames are traced while the camera moves (or always, when progressive mode is off)
+		enum class InteractiveMode
+		{
+			FullResolution,
+			DynamicResolution,
+			Reprojection,
+			Checkerboard,
+		};
+
 		Renderer(SDL_Window* pWindow);
+		//Off-screen rendering into pBuffer, Present only resolves into it
+		Renderer(SDL_Surface* pBuffer);
 		~Renderer() = default;
 
 		Renderer(const Renderer&) = delete;
@@ -27,36 +45,181 @@ namespace dae
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
+		//Traces, swaps and presents in one go
+		void Render(Scene* pScene);
 
+		//Pipelined frames: BeginRender traces the next frame on a worker while the main thread
+		//presents the previous one. The scene and renderer settings must not change until EndRender
+		void BeginRender(Scene* pScene);
+		void EndRender();
+		void Present() const;
 
 
 		void RenderPixel(Scene* scene, uint32_t pixelIndex,
-			const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials) const;
+			const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials);
 
 		bool SaveBufferToImage() const;
+		//Writes the last traced traversal cost as a heat map, only available once the cost view was shown
+		bool SaveCostMapToImage() const;
 
 		void CycleLightingMode();
-		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; }
+		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; ResetAccumulation(); ResetHistory(); }
+		void ToggleOccluderCache() { m_OccluderCacheEnabled = !m_OccluderCacheEnabled; }
+		void ToggleProgressive() { m_ProgressiveEnabled = !m_ProgressiveEnabled; ResetAccumulation(); }
+		void SetProgressive(bool isEnabled) { m_ProgressiveEnabled = isEnabled; ResetAccumulation(); }
+		bool IsProgressive() const { return m_ProgressiveEnabled; }
+		void ResetAccumulation() { m_AccumulatedSamples = 0; m_HasCheckerboardHistory = false; }
+		void ToggleAdaptiveSampling() { m_AdaptiveSamplingEnabled = !m_AdaptiveSamplingEnabled; ResetAccumulation(); }
+		void CycleInteractiveMode();
+		void CycleLightSampling();
+		void SetNumLightSamples(int numSamples) { m_NumLightSamples = numSamples > 0 ? numSamples : 1; ResetAccumulation(); ResetHistory(); }
+		void SetInteractiveMode(InteractiveMode mode) { m_CurrentInteractiveMode = mode; ResetHistory(); }
+		void SetLightCullThreshold(float threshold) { m_LightCullThreshold = threshold; ResetAccumulation(); ResetHistory(); }
+		void SetMinimumFPS(float minimumFPS) { m_TargetFrameTime = 1.f / minimumFPS; }
+		float GetRenderScale() const { return m_RenderScale; }
+		float GetLastTraceTime() const { return m_LastTraceTime; }
+		RenderTarget& GetRenderTarget() { return m_RenderTarget; }
 
 
 	private:
+		void TraceFrame(Scene* pScene);
+		ColorRGB TracePixel(Scene* scene, float pxc, float pyc,
+			const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials,
+			HitRecord* pClosestHit = nullptr);
+		bool IsLightOccluded(const Scene* scene, const Vector3& hitPoint, const Vector3& lightDirection, float lightDistance, size_t lightIdx) const;
+		ColorRGB ShadeLight(const Light& light, const HitRecord& closestHit, const Vector3& lightDirection, float observedArea,
+			const Vector3& viewDirection, const std::vector<Material*>& materials) const;
+		void WritePixel(int px, int py, const ColorRGB& color) { m_RenderTarget.SetPixel(px, py, color); }
+		void ResolveRenderTarget() const;
+		bool HasCameraMoved(const Camera& camera);
+		void UpdateRenderScale(float frameTime);
+		void UpscaleToBuffer();
+		void UpdateAdaptiveTiles();
+		void ReprojectPreviousFrame(const Camera& camera);
+		bool CanReusePixel(int px, int py) const;
+		void ReconstructCheckerboard();
+		void ResetHistory() { m_HasReprojectionCache = false; m_HasCheckerboardHistory = false; }
+		//Sampled lights leave noise in flat areas that only more samples remove, so every tile keeps refining
+		bool IsAdaptiveSamplingActive() const { return m_AdaptiveSamplingEnabled && m_CurrentLightSampling == LightSampling::Exhaustive; }
+
 		enum class LightingMode
 		{
 			ObservedArea,
 			Radiance,
 			BRDF,
 			Combined,
+			TraversalCost,
+		};
+
+		//A light that survived culling at a hit, waiting for its shadow ray
+		struct LightCandidate
+		{
+			const Light* pLight{};
+			Vector3 direction{};
+			float distance{};
+			float observedArea{};
+			//1 when every light is evaluated, 1 / (pdf * samples) for a sampled light
+			float weight{ 1.f };
+		};
+
+		void AddLightCandidate(const Light& light, const Vector3& hitPoint, const HitRecord& closestHit, float threshold, float weight,
+			std::pmr::vector<LightCandidate>& candidates) const;
+
+		enum class LightSampling
+		{
+			//Every light the light tree can't cull gets a shadow ray
+			Exhaustive,
+			//A fixed number of lights per hit picked by the light tree's importance
+			LightTree,
+			//A fixed number of lights per hit picked by power alone, in constant time per pick
+			PowerAlias,
 		};
 
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
+		InteractiveMode m_CurrentInteractiveMode{ InteractiveMode::DynamicResolution };
 		bool m_ShadowsEnabled{ true };
+		//Shadow rays first test whatever blocked the previous ray of this thread towards the same light
+		bool m_OccluderCacheEnabled{ true };
+		//Lights whose radiance * cos bound at a hit stays under this are skipped, shadow ray included
+		float m_LightCullThreshold{ 0.001f };
+		LightSampling m_CurrentLightSampling{ LightSampling::Exhaustive };
+		int m_NumLightSamples{ 1 };
+
+		//Progressive refinement: jittered samples are summed while the camera and the scene are still
+		bool m_ProgressiveEnabled{ true };
+		//Also set for a frame in which the scene changed, both restart accumulation
+		bool m_IsCameraMoving{ true };
+		uint32_t m_AccumulatedSamples{};
+		uint32_t m_TargetSampleCount{ 64 };
+		std::vector<ColorRGB> m_AccumulationBuffer{};
+
+		//Adaptive sampling: after the first still frame only tiles with enough contrast keep receiving samples
+		bool m_AdaptiveSamplingEnabled{ true };
+		int m_TileSize{ 8 };
+		int m_NumTilesX{};
+		float m_ContrastThreshold{ 0.1f };
+		std::vector<uint8_t> m_TileNeedsSamples{};
+
+		//Temporal reprojection: interactive frames project last frame's hit points into the new view,
+		//holes, material edges and a rotating 1 / m_RefreshInterval of the pixels are traced again
+		struct CachedSample
+		{
+			Vector3 position{};
+			ColorRGB color{};
+			unsigned char materialIndex{};
+			bool didHit{};
+		};
+
+		static constexpr uint32_t m_InvalidSource{ UINT32_MAX };
+
+		bool m_IsReprojectedFrame{};
+		bool m_HasReprojectionCache{};
+		uint32_t m_RefreshInterval{ 8 };
+		uint32_t m_FrameIndex{};
+		std::vector<CachedSample> m_ReprojectionCache{};
+		std::vector<CachedSample> m_PreviousReprojectionCache{};
+		std::vector<float> m_ReprojectedDepth{};
+		std::vector<uint32_t> m_ReprojectedSource{};
+
+		//Dynamic resolution: interactive frames are traced at m_RenderScale and upscaled bilinearly,
+		//the scale follows the measured frame time so it stays under m_TargetFrameTime
+		bool m_IsScaledFrame{};
+		float m_RenderScale{ 1.f };
+		float m_MinRenderScale{ 0.25f };
+		float m_TargetFrameTime{ 1.f / 30.f };
+		int m_ScaledWidth{};
+		int m_ScaledHeight{};
+		std::vector<ColorRGB> m_ScaledBuffer{};
+
+		//Checkerboard: interactive frames trace the pixels where (px + py + frame) is even,
+		//the others are last frame's value clamped to the range of their four traced neighbours
+		bool m_IsCheckerboardFrame{};
+		bool m_HasCheckerboardHistory{};
+		std::vector<ColorRGB> m_CheckerboardBuffer{};
+
+		//Traversal cost view: BVH nodes visited plus triangles tested per pixel in a stats build (RAY_STATS),
+		//wall-clock nanoseconds otherwise. Shown on a log scale against the most expensive pixel of the previous frame
+		std::vector<uint32_t> m_CostBuffer{};
+		std::atomic<uint32_t> m_MaxPixelCost{};
+		uint32_t m_CostScale{ 1 };
+		bool m_HasCostMap{};
+
+		//Wall time of the last traced frame in seconds, converged frames leave it untouched
+		float m_LastTraceTime{};
+
+		Vector3 m_LastCameraOrigin{};
+		Vector3 m_LastCameraForward{};
+		float m_LastCameraFOV{};
+		uint64_t m_LastSceneVersion{};
 
 
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pBuffer{};
-		uint32_t* m_pBufferPixels{};
+		RenderTarget m_RenderTarget;
+
+		std::future<void> m_FrameInFlight{};
+		bool m_HasNewFrame{};
 
 		int m_Width{};
 		float m_WidthDivision;
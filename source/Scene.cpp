@@ -1,6 +1,12 @@
 #include "Scene.h"
 #include "Utils.h"
 #include "Material.h"
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <iostream>
+#include <ppl.h>
+#include <unordered_set>
 
 #define BVH
 
@@ -30,6 +36,7 @@ namespace dae {
 
 	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& hitRecord) const
 	{
+		RAY_STATS_INC(PrimaryRays);
 
 		HitRecord toKeepRecord{};
 
@@ -42,6 +49,18 @@ namespace dae {
 			}
 		}
 
+		GetClosestObjectHit(ray, hitRecord);
+
+		if (hitRecord.didHit)
+		{
+			RAY_STATS_INC(PrimaryHits);
+		}
+	}
+
+	void Scene::GetClosestObjectHit(const Ray& ray, HitRecord& hitRecord) const
+	{
+		HitRecord toKeepRecord{};
+
 		for (auto& pMesh : m_TriangleMeshGeometries)
 		{
 			GeometryUtils::HitTest_TriangleMesh(pMesh, ray, toKeepRecord);
@@ -59,35 +78,116 @@ namespace dae {
 				hitRecord = toKeepRecord;
 			}
 		}
+	}
 
+	bool Scene::IsLightOccluded(const Ray& ray, size_t lightIdx, ShadowOccluder& occluder) const
+	{
+		if (lightIdx < m_ShadowGrids.size() && m_ShadowGrids[lightIdx])
+		{
+			RAY_STATS_INC(ShadowGridLookups);
+			switch (m_ShadowGrids[lightIdx]->Lookup(ray.origin))
+			{
+			case ShadowGrid::Visibility::Lit:
+				//Planes aren't in the grid
+				RAY_STATS_INC(ShadowGridResolved);
+				return DoesHitPlane(ray);
+			case ShadowGrid::Visibility::Occluded:
+				RAY_STATS_INC(ShadowGridResolved);
+				return true;
+			default:
+				break;
+			}
+		}
 
+		return DoesHit(ray, occluder);
 	}
 
-	bool Scene::DoesHit(const Ray& ray) const
+	bool Scene::DoesHitPlane(const Ray& ray) const
 	{
 		for (auto& pPlanes : m_PlaneGeometries)
 		{
 			if (GeometryUtils::HitTest_Plane(pPlanes, ray))
 				return true;
 		}
+		return false;
+	}
 
-		for (auto& pMesh : m_TriangleMeshGeometries)
+	bool Scene::DoesHit(const Ray& ray) const
+	{
+		ShadowOccluder occluder{};
+		return DoesHit(ray, occluder);
+	}
+
+	bool Scene::DoesHit(const Ray& ray, ShadowOccluder& occluder) const
+	{
+		RAY_STATS_INC(ShadowRays);
+
+		if (occluder.type != ShadowOccluder::Type::None)
 		{
-		
-			if (GeometryUtils::HitTest_TriangleMesh(pMesh, ray))
+			RAY_STATS_INC(OccluderCacheTests);
+			if (DoesHitOccluder(ray, occluder))
+			{
+				RAY_STATS_INC(OccluderCacheHits);
+				RAY_STATS_INC(ShadowHits);
 				return true;
+			}
 		}
-		
-		for (auto& pSphere : m_SphereGeometries)
+
+		for (unsigned int planeIdx{}; planeIdx < m_PlaneGeometries.size(); ++planeIdx)
 		{
-			if (GeometryUtils::HitTest_Sphere(pSphere, ray))
+			if (GeometryUtils::HitTest_Plane(m_PlaneGeometries[planeIdx], ray))
+			{
+				RAY_STATS_INC(ShadowHits);
+				occluder = ShadowOccluder{ ShadowOccluder::Type::Plane, planeIdx };
 				return true;
+			}
 		}
 
+		for (unsigned int meshIdx{}; meshIdx < m_TriangleMeshGeometries.size(); ++meshIdx)
+		{
+			unsigned int triangleIdx{};
+			if (GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[meshIdx], ray, triangleIdx))
+			{
+				RAY_STATS_INC(ShadowHits);
+				occluder = ShadowOccluder{ ShadowOccluder::Type::Triangle, meshIdx, triangleIdx };
+				return true;
+			}
+		}
 
+		for (unsigned int sphereIdx{}; sphereIdx < m_SphereGeometries.size(); ++sphereIdx)
+		{
+			if (GeometryUtils::HitTest_Sphere(m_SphereGeometries[sphereIdx], ray))
+			{
+				RAY_STATS_INC(ShadowHits);
+				occluder = ShadowOccluder{ ShadowOccluder::Type::Sphere, sphereIdx };
+				return true;
+			}
+		}
+
+		//Lit regions would keep testing a stale occluder otherwise
+		occluder = ShadowOccluder{};
 		return false;
 	}
 
+	bool Scene::DoesHitOccluder(const Ray& ray, const ShadowOccluder& occluder) const
+	{
+		//Indices are checked, a cache can outlive the geometry it was filled with
+		switch (occluder.type)
+		{
+		case ShadowOccluder::Type::Plane:
+			return occluder.geometryIdx < m_PlaneGeometries.size() &&
+				GeometryUtils::HitTest_Plane(m_PlaneGeometries[occluder.geometryIdx], ray);
+		case ShadowOccluder::Type::Sphere:
+			return occluder.geometryIdx < m_SphereGeometries.size() &&
+				GeometryUtils::HitTest_Sphere(m_SphereGeometries[occluder.geometryIdx], ray);
+		case ShadowOccluder::Type::Triangle:
+			return occluder.geometryIdx < m_TriangleMeshGeometries.size() &&
+				GeometryUtils::HitTest_MeshTriangle(m_TriangleMeshGeometries[occluder.geometryIdx], occluder.triangleIdx, ray);
+		default:
+			return false;
+		}
+	}
+
 #pragma region Scene Helpers
 	Sphere* Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
 	{
@@ -97,6 +197,7 @@ namespace dae {
 		s.materialIndex = materialIndex;
 
 		m_SphereGeometries.emplace_back(s);
+		MarkGeometryChanged();
 		return &m_SphereGeometries.back();
 	}
 
@@ -108,17 +209,266 @@ namespace dae {
 		p.materialIndex = materialIndex;
 
 		m_PlaneGeometries.emplace_back(p);
+		MarkGeometryChanged();
 		return &m_PlaneGeometries.back();
 	}
 
-	TriangleMesh* Scene::AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex)
+	std::shared_ptr<MeshGeometry> Scene::CreateMeshGeometry()
+	{
+		//Control block and buffers share the arena, which outlives every mesh of the scene
+		return std::allocate_shared<MeshGeometry>(std::pmr::polymorphic_allocator<MeshGeometry>{ &m_GeometryArena }, &m_GeometryArena);
+	}
+
+	MeshHandle Scene::AddTriangleMesh(std::shared_ptr<const MeshGeometry> pGeometry, TriangleCullMode cullMode, unsigned char materialIndex)
+	{
+		return EmplaceTriangleMesh(TriangleMesh{ std::move(pGeometry), cullMode, materialIndex });
+	}
+
+	MeshHandle Scene::AddTriangleMesh(std::shared_ptr<const PagedMeshGeometry> pGeometry, TriangleCullMode cullMode, unsigned char materialIndex)
+	{
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+		if (pGeometry)
+		{
+			minAABB = pGeometry->GetMinAABB();
+			maxAABB = pGeometry->GetMaxAABB();
+		}
+		return EmplaceTriangleMesh(TriangleMesh{ std::move(pGeometry), minAABB, maxAABB, cullMode, materialIndex });
+	}
+
+	MeshHandle Scene::EmplaceTriangleMesh(TriangleMesh&& mesh)
+	{
+		unsigned int slotIdx{};
+		if (!m_FreeMeshSlots.empty())
+		{
+			slotIdx = m_FreeMeshSlots.back();
+			m_FreeMeshSlots.pop_back();
+		}
+		else
+		{
+			slotIdx = static_cast<unsigned int>(m_MeshSlots.size());
+			m_MeshSlots.emplace_back();
+		}
+
+		MeshSlot& slot{ m_MeshSlots[slotIdx] };
+		slot.denseIdx = static_cast<unsigned int>(m_TriangleMeshGeometries.size());
+
+		m_TriangleMeshGeometries.push_back(std::move(mesh));
+		m_MeshDenseToSlot.push_back(slotIdx);
+		MarkGeometryChanged();
+
+		return MeshHandle{ slotIdx, slot.generation };
+	}
+
+	void Scene::RemoveTriangleMesh(MeshHandle handle)
+	{
+		if (!GetTriangleMesh(handle))
+			return;
+
+		MeshSlot& slot{ m_MeshSlots[handle.index] };
+		const unsigned int lastDenseIdx{ static_cast<unsigned int>(m_TriangleMeshGeometries.size() - 1) };
+
+		//Swap with the last mesh so the dense array stays packed, then repoint the slot of the moved mesh
+		if (slot.denseIdx != lastDenseIdx)
+		{
+			m_TriangleMeshGeometries[slot.denseIdx] = std::move(m_TriangleMeshGeometries[lastDenseIdx]);
+			m_MeshDenseToSlot[slot.denseIdx] = m_MeshDenseToSlot[lastDenseIdx];
+			m_MeshSlots[m_MeshDenseToSlot[slot.denseIdx]].denseIdx = slot.denseIdx;
+		}
+		m_TriangleMeshGeometries.pop_back();
+		m_MeshDenseToSlot.pop_back();
+
+		++slot.generation;
+		m_FreeMeshSlots.push_back(handle.index);
+		MarkGeometryChanged();
+	}
+
+	TriangleMesh* Scene::GetTriangleMesh(MeshHandle handle)
+	{
+		if (handle.index >= m_MeshSlots.size() || m_MeshSlots[handle.index].generation != handle.generation)
+			return nullptr;
+
+		return &m_TriangleMeshGeometries[m_MeshSlots[handle.index].denseIdx];
+	}
+
+	void Scene::PrintMemoryUsage() const
+	{
+		size_t usedBytes{ m_GeometryArena.GetUsedBytes() };
+		size_t reservedBytes{ m_GeometryArena.GetReservedBytes() };
+		size_t numBlocks{ m_GeometryArena.GetBlockCount() };
+		for (const std::unique_ptr<Arena>& pArena : m_LoadArenas)
+		{
+			if (!pArena)
+				continue;
+
+			usedBytes += pArena->GetUsedBytes();
+			reservedBytes += pArena->GetReservedBytes();
+			numBlocks += pArena->GetBlockCount();
+		}
+		std::cout << "**MEMORY** geometry arenas: " << usedBytes / 1024 << " KiB used of "
+			<< reservedBytes / 1024 << " KiB reserved in " << numBlocks << " blocks" << std::endl;
+
+		//Shared geometry counted once, however many meshes place it
+		std::unordered_set<const MeshGeometry*> geometries{};
+		size_t geometryBytes{};
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			if (mesh.pGeometry && geometries.insert(mesh.pGeometry.get()).second)
+				geometryBytes += mesh.pGeometry->GetMemoryBytes();
+
+			for (const std::shared_ptr<const MeshGeometry>& pLODGeometry : mesh.lodGeometries)
+			{
+				if (geometries.insert(pLODGeometry.get()).second)
+					geometryBytes += pLODGeometry->GetMemoryBytes();
+			}
+		}
+		std::cout << "**MEMORY** " << m_TriangleMeshGeometries.size() << " meshes over " << geometries.size() << " geometries: "
+			<< geometryBytes / 1024 << " KiB of vertices, indices and BVH nodes" << std::endl;
+
+		std::unordered_set<const PagedMeshGeometry*> pagedGeometries{};
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			if (!mesh.pPagedGeometry || !pagedGeometries.insert(mesh.pPagedGeometry.get()).second)
+				continue;
+
+			const PagedMeshGeometry& geometry{ *mesh.pPagedGeometry };
+			std::cout << "**MEMORY** paged geometry: " << geometry.GetResidentPageCount() << " of " << geometry.GetPageCount() << " pages of "
+				<< geometry.GetPageSize() / 1024 << " KiB resident, " << geometry.GetPageFaultCount() << " page faults, "
+				<< geometry.GetEvictionCount() << " evictions" << std::endl;
+		}
+	}
+
+	void Scene::BuildShadowGrids(int resolution)
+	{
+		m_ShadowGrids.clear();
+		m_ShadowGrids.resize(m_Lights.size());
+
+		//UpdateLODs picks the LODs again before the next frame
+		for (TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			if (!mesh.lodGeometries.empty())
+				mesh.SelectLOD(0);
+		}
+
+		//Bounds of the finite geometry, infinite planes are tested exactly instead
+		Vector3 minAABB{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 maxAABB{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (const Sphere& sphere : m_SphereGeometries)
+		{
+			const Vector3 extent{ sphere.radius, sphere.radius, sphere.radius };
+			minAABB = Vector3::Min(minAABB, sphere.origin - extent);
+			maxAABB = Vector3::Max(maxAABB, sphere.origin + extent);
+		}
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			minAABB = Vector3::Min(minAABB, mesh.transformedMinAABB);
+			maxAABB = Vector3::Max(maxAABB, mesh.transformedMaxAABB);
+		}
+
+		if (minAABB.x > maxAABB.x)
+			return;
+
+		for (size_t lightIdx{}; lightIdx < m_Lights.size(); ++lightIdx)
+		{
+			if (m_Lights[lightIdx].type != LightType::Directional)
+				continue;
+
+			auto pGrid{ std::make_unique<ShadowGrid>(-m_Lights[lightIdx].direction, minAABB, maxAABB, resolution) };
+			const ShadowGrid& grid{ *pGrid };
+			const int gridResolution{ grid.GetResolution() };
+
+			concurrency::parallel_for(0, gridResolution * gridResolution, [&](int cellIdx)
+				{
+					const int x{ cellIdx % gridResolution };
+					const int y{ cellIdx / gridResolution };
+
+					HitRecord hitRecord{};
+					GetClosestObjectHit(grid.GetCellRay(x, y), hitRecord);
+					pGrid->SetCellHit(x, y, hitRecord.didHit ? hitRecord.t : FLT_MAX);
+				});
+
+			m_ShadowGrids[lightIdx] = std::move(pGrid);
+		}
+	}
+
+	void Scene::UpdateLightSampling()
 	{
-		TriangleMesh m{};
-		m.cullMode = cullMode;
-		m.materialIndex = materialIndex;
+		if (!m_AreLightsDirty)
+			return;
+
+		m_LightTree.Build(m_Lights);
+
+		std::vector<float> lightPowers(m_Lights.size());
+		for (size_t i{}; i < m_Lights.size(); ++i)
+		{
+			if (m_Lights[i].type == LightType::Point)
+				lightPowers[i] = m_Lights[i].intensity * m_Lights[i].color.GetLuminance();
+		}
+		m_LightAliasTable.Build(lightPowers);
 
-		m_TriangleMeshGeometries.emplace_back(m);
-		return &m_TriangleMeshGeometries.back();
+		m_AreLightsDirty = false;
+	}
+
+	void Scene::UpdateLODs()
+	{
+		m_SelectedTriangles = 0;
+		m_LODCandidates.clear();
+
+		for (size_t meshIdx{}; meshIdx < m_TriangleMeshGeometries.size(); ++meshIdx)
+		{
+			TriangleMesh& mesh{ m_TriangleMeshGeometries[meshIdx] };
+			if (mesh.lodGeometries.empty())
+			{
+				if (mesh.pGeometry)
+					m_SelectedTriangles += mesh.pGeometry->GetIndexCount() / 3;
+				continue;
+			}
+
+			//Bounding sphere diameter against the view height at its distance (cameraFOV is the tangent of half
+			//the fov, so the radius goes against half the height). The camera inside it gets full detail
+			const Vector3 center{ (mesh.transformedMinAABB + mesh.transformedMaxAABB) * 0.5f };
+			const float radius{ (mesh.transformedMaxAABB - mesh.transformedMinAABB).Magnitude() * 0.5f };
+			const float distance{ (center - m_Camera.origin).Magnitude() };
+			const float projectedSize{ distance > radius ? radius / (distance * m_Camera.cameraFOV) : FLT_MAX };
+
+			//The coarsest level that still has the triangles the projected area asks for
+			const float detail{ std::min(projectedSize / m_LODFullDetailSize, 1.f) };
+			const size_t targetTriangles{ static_cast<size_t>(detail * detail * (mesh.lodGeometries.front()->GetIndexCount() / 3)) };
+
+			unsigned int lodIdx{};
+			while (lodIdx + 1 < mesh.lodGeometries.size() && mesh.lodGeometries[lodIdx + 1]->GetIndexCount() / 3 >= targetTriangles)
+				++lodIdx;
+
+			mesh.SelectLOD(lodIdx);
+			m_SelectedTriangles += mesh.pGeometry->GetIndexCount() / 3;
+			m_LODCandidates.emplace_back(projectedSize, meshIdx);
+		}
+
+		if (m_TriangleBudget == 0 || m_SelectedTriangles <= m_TriangleBudget)
+			return;
+
+		//Over budget: step the smallest meshes down a level at a time, in passes so detail is taken evenly
+		std::sort(m_LODCandidates.begin(), m_LODCandidates.end());
+
+		bool isCoarsened{ true };
+		while (isCoarsened && m_SelectedTriangles > m_TriangleBudget)
+		{
+			isCoarsened = false;
+			for (const auto& [projectedSize, meshIdx] : m_LODCandidates)
+			{
+				TriangleMesh& mesh{ m_TriangleMeshGeometries[meshIdx] };
+				if (mesh.lodIdx + 1 >= mesh.lodGeometries.size())
+					continue;
+
+				m_SelectedTriangles -= mesh.pGeometry->GetIndexCount() / 3;
+				mesh.SelectLOD(mesh.lodIdx + 1);
+				m_SelectedTriangles += mesh.pGeometry->GetIndexCount() / 3;
+				isCoarsened = true;
+
+				if (m_SelectedTriangles <= m_TriangleBudget)
+					break;
+			}
+		}
 	}
 
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
@@ -130,18 +480,20 @@ namespace dae {
 		l.type = LightType::Point;
 
 		m_Lights.emplace_back(l);
+		MarkLightsChanged();
 		return &m_Lights.back();
 	}
 
 	Light* Scene::AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color)
 	{
 		Light l;
-		l.direction = direction;
+		l.direction = direction.Normalized();
 		l.intensity = intensity;
 		l.color = color;
 		l.type = LightType::Directional;
 
 		m_Lights.emplace_back(l);
+		MarkLightsChanged();
 		return &m_Lights.back();
 	}
 
@@ -174,6 +526,9 @@ namespace dae {
 		AddPlane({ 0.f, -75.f, 0.f }, { 0.f, 1.f,0.f }, matId_Solid_Yellow);
 		AddPlane({ 0.f, 75.f, 0.f }, { 0.f, -1.f,0.f }, matId_Solid_Yellow);
 		AddPlane({ 0.f, 0.f, 125.f }, { 0.f, 0.f,-1.f }, matId_Solid_Magenta);
+
+		//Light, without one every lighting mode renders the scene black
+		AddPointLight({ 0.f, 50.f, -25.f }, 5000.f, colors::White);
 	}
 #pragma endregion
 	void Scene_W2::Initialize()
@@ -282,7 +637,7 @@ namespace dae {
 		//m_Triangles.emplace_back(triangle);
 
 
-		pMesh = AddTriangleMesh(TriangleCullMode::NoCulling, matLambert_White);
+		const std::shared_ptr<MeshGeometry> pCube{ CreateMeshGeometry() };
 
 		//pMesh->positions = { 
 		//	{-.75,-1.f,.0f}, 
@@ -297,11 +652,15 @@ namespace dae {
 
 		Utils::ParseOBJ(
 			"Resources/simple_cube.obj",
-			pMesh->positions,
-			pMesh->normals,
-			pMesh->indices);
+			pCube->positions,
+			pCube->normals,
+			pCube->indices);
+
+		pCube->CalculateNormals();
+		pCube->Build();
 
-		pMesh->CalculateNormals();
+		m_Mesh = AddTriangleMesh(pCube, TriangleCullMode::NoCulling, matLambert_White);
+		TriangleMesh* pMesh{ GetTriangleMesh(m_Mesh) };
 
 		pMesh->Translate({ 0.f,1.5f,0.f });
 
@@ -317,10 +676,12 @@ namespace dae {
 	{
 		Scene::Update(pTimer);
 
+		TriangleMesh* pMesh{ GetTriangleMesh(m_Mesh) };
 		pMesh->RotateY(PI_DIV_2 * pTimer->GetTotal());
 
 		pMesh->UpdateTransforms();
 
+		MarkGeometryChanged();
 	}
 
 	void Scene_W4_ReferneceScene::Initialize()
@@ -356,23 +717,20 @@ namespace dae {
 
 		const Triangle baseTriangle = { Vector3(-0.75f, 1.5f, 0.0f), Vector3(0.75f, 0.0f, 0.0f), Vector3(-0.75f, 0.0f, 0.0f) };
 
-		m_pMeshes[0] = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		m_pMeshes[0]->AppendTriangle(baseTriangle, true);
-		m_pMeshes[0]->Translate({ -1.75f, 4.5f, 0.0f });
-		m_pMeshes[0]->UpdateAABB();
-		m_pMeshes[0]->UpdateTransforms();
-
-		m_pMeshes[1] = AddTriangleMesh(TriangleCullMode::FrontFaceCulling, matLambert_White);
-		m_pMeshes[1]->AppendTriangle(baseTriangle, true);
-		m_pMeshes[1]->Translate({ 0.0f, 4.5f, 0.0f });
-		m_pMeshes[1]->UpdateAABB();
-		m_pMeshes[1]->UpdateTransforms();
+		//One triangle, placed three times with different culling
+		const std::shared_ptr<MeshGeometry> pTriangle{ CreateMeshGeometry() };
+		pTriangle->AppendTriangle(baseTriangle);
+		pTriangle->Build();
 
-		m_pMeshes[2] = AddTriangleMesh(TriangleCullMode::NoCulling, matLambert_White);
-		m_pMeshes[2]->AppendTriangle(baseTriangle, true);
-		m_pMeshes[2]->Translate({ 1.75f, 4.5f, 0.0f });
-		m_pMeshes[2]->UpdateAABB();
-		m_pMeshes[2]->UpdateTransforms();
+		const TriangleCullMode cullModes[3]{ TriangleCullMode::BackFaceCulling, TriangleCullMode::FrontFaceCulling, TriangleCullMode::NoCulling };
+		const float offsetsX[3]{ -1.75f, 0.0f, 1.75f };
+		for (int i{}; i < 3; ++i)
+		{
+			m_Meshes[i] = AddTriangleMesh(pTriangle, cullModes[i], matLambert_White);
+			TriangleMesh* pMesh{ GetTriangleMesh(m_Meshes[i]) };
+			pMesh->Translate({ offsetsX[i], 4.5f, 0.0f });
+			pMesh->UpdateTransforms();
+		}
 
 		//Light
 		AddPointLight(Vector3{ 0.0f, 5.0f, 5.0f }, 50.f, ColorRGB{ 1.0f, 0.61f, 0.45f }); // Backlight
@@ -387,12 +745,14 @@ namespace dae {
 
 		const float yawAngle{ (cos(pTimer->GetTotal()) + 1.f) / 2.f * PI_2 };
 
-		for (const auto& m : m_pMeshes)
+		for (const MeshHandle& handle : m_Meshes)
 		{
-			m->RotateY(yawAngle);
-			m->UpdateTransforms();
+			TriangleMesh* pMesh{ GetTriangleMesh(handle) };
+			pMesh->RotateY(yawAngle);
+			pMesh->UpdateTransforms();
 		}
 
+		MarkGeometryChanged();
 	}
 
 	void Scene_W4_Bunny::Initialize()
@@ -411,16 +771,16 @@ namespace dae {
 		AddPlane(Vector3{ 5.f, 0.f, 0.f }, Vector3{ -1.f, 0.f, 0.f }, matLambert_GrayBlue);; //Right
 		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue);; //Left
 
-		pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
+		const std::shared_ptr<MeshGeometry> pBunny{ CreateMeshGeometry() };
 
-		Utils::ParseOBJ("Resources/lowpoly_bunny2.obj", pMesh->positions, pMesh->normals, pMesh->indices);
+		Utils::ParseOBJ("Resources/lowpoly_bunny2.obj", pBunny->positions, pBunny->normals, pBunny->indices);
+		pBunny->Build();
 
+		m_Mesh = AddTriangleMesh(pBunny, TriangleCullMode::BackFaceCulling, matLambert_White);
+		TriangleMesh* pMesh{ GetTriangleMesh(m_Mesh) };
 
 		pMesh->Scale({ 2.f, 2.f, 2.f });
 
-#ifndef BVH
-		pMesh->UpdateAABB();
-#endif
 		pMesh->UpdateTransforms();
 		//Light
 		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, 0.61f, .45f });//backLight
@@ -433,8 +793,146 @@ namespace dae {
 
 		const float yawAngle{ (cos(pTimer->GetTotal()) + 1.f) / 2.f * PI_2 };
 
+		TriangleMesh* pMesh{ GetTriangleMesh(m_Mesh) };
 		pMesh->RotateY(yawAngle);
 		pMesh->UpdateTransforms();
 
+		MarkGeometryChanged();
+	}
+
+	void Scene_File::Initialize()
+	{
+		sceneName = m_Filename;
+
+		SceneDescription description{};
+		if (!SceneFile::Load(m_Filename, description))
+			return;
+
+		m_Camera = { description.cameraOrigin, description.cameraFov };
+
+		//File materials come after the default one
+		std::vector<unsigned char> materialIndices{};
+		for (const SceneDescription::MaterialDesc& material : description.materials)
+		{
+			const float* params{ material.params };
+			switch (material.type)
+			{
+			case SceneDescription::MaterialDesc::Type::SolidColor:
+				materialIndices.push_back(AddMaterial(new Material_SolidColor(material.color)));
+				break;
+			case SceneDescription::MaterialDesc::Type::Lambert:
+				materialIndices.push_back(AddMaterial(new Material_Lambert(material.color, params[0])));
+				break;
+			case SceneDescription::MaterialDesc::Type::LambertPhong:
+				materialIndices.push_back(AddMaterial(new Material_LambertPhong(material.color, params[0], params[1], params[2])));
+				break;
+			case SceneDescription::MaterialDesc::Type::CookTorrence:
+				materialIndices.push_back(AddMaterial(new Material_CookTorrence(material.color, params[0], params[1])));
+				break;
+			}
+		}
+
+		for (const Plane& plane : description.planes)
+			AddPlane(plane.origin, plane.normal, materialIndices[plane.materialIndex]);
+
+		for (const Sphere& sphere : description.spheres)
+			AddSphere(sphere.origin, sphere.radius, materialIndices[sphere.materialIndex]);
+
+		//Every mesh and each of its LODs is parsed and gets its BVH on its own thread, in an arena of its own
+		//as the scene arena isn't thread safe. Paged meshes only have their top tree read
+		std::vector<std::vector<std::shared_ptr<const MeshGeometry>>> lodChains(description.meshes.size());
+		std::vector<std::shared_ptr<PagedMeshGeometry>> pagedGeometries(description.meshes.size());
+		std::vector<std::pair<size_t, size_t>> meshLevels{};
+		for (size_t meshIdx{}; meshIdx < description.meshes.size(); ++meshIdx)
+		{
+			const size_t numLevels{ 1 + description.meshes[meshIdx].lodPaths.size() };
+			lodChains[meshIdx].resize(numLevels);
+			for (size_t level{}; level < numLevels; ++level)
+				meshLevels.emplace_back(meshIdx, level);
+		}
+
+		m_LoadArenas.resize(meshLevels.size());
+		concurrency::parallel_for(size_t{}, meshLevels.size(), [&](size_t loadIdx)
+			{
+				const auto [meshIdx, level] { meshLevels[loadIdx] };
+				const SceneDescription::MeshDesc& mesh{ description.meshes[meshIdx] };
+				if (mesh.residentBudgetMiB > 0)
+				{
+					pagedGeometries[meshIdx] = PagedMeshGeometry::Open(mesh.path, size_t{ mesh.residentBudgetMiB } << 20);
+					return;
+				}
+
+				m_LoadArenas[loadIdx] = std::make_unique<Arena>();
+				Arena& arena{ *m_LoadArenas[loadIdx] };
+				auto pGeometry{ std::allocate_shared<MeshGeometry>(std::pmr::polymorphic_allocator<MeshGeometry>{ &arena }, &arena) };
+				const std::string& path{ level == 0 ? mesh.path : mesh.lodPaths[level - 1] };
+				if (!Utils::ParseOBJ(path, pGeometry->positions, pGeometry->normals, pGeometry->indices))
+					return;
+
+				pGeometry->Build();
+				if (mesh.compress)
+					pGeometry->Compress(mesh.quantizePositions);
+
+				lodChains[meshIdx][level] = std::move(pGeometry);
+			});
+
+		//A LOD that didn't load is left out of its chain, a mesh whose full detail level didn't is left out entirely
+		for (size_t meshIdx{}; meshIdx < lodChains.size(); ++meshIdx)
+		{
+			const SceneDescription::MeshDesc& mesh{ description.meshes[meshIdx] };
+			std::vector<std::shared_ptr<const MeshGeometry>>& lodChain{ lodChains[meshIdx] };
+
+			if (!lodChain.front() && !pagedGeometries[meshIdx])
+			{
+				std::cout << m_Filename << ": couldn't load mesh " << mesh.path << std::endl;
+				lodChain.clear();
+				continue;
+			}
+
+			for (size_t level{ 1 }; level < lodChain.size(); ++level)
+			{
+				if (!lodChain[level])
+					std::cout << m_Filename << ": couldn't load LOD " << mesh.lodPaths[level - 1] << std::endl;
+			}
+			lodChain.erase(std::remove(lodChain.begin(), lodChain.end(), nullptr), lodChain.end());
+		}
+
+		for (const SceneDescription::InstanceDesc& instance : description.instances)
+		{
+			const std::vector<std::shared_ptr<const MeshGeometry>>& lodChain{ lodChains[instance.meshIdx] };
+			const unsigned char materialIndex{ materialIndices[instance.materialIndex] };
+
+			MeshHandle handle{};
+			if (!lodChain.empty())
+				handle = AddTriangleMesh(lodChain.front(), instance.cullMode, materialIndex);
+			else if (pagedGeometries[instance.meshIdx])
+				handle = AddTriangleMesh(pagedGeometries[instance.meshIdx], instance.cullMode, materialIndex);
+			else
+				continue;
+
+			TriangleMesh* pMesh{ GetTriangleMesh(handle) };
+			if (lodChain.size() > 1)
+				pMesh->lodGeometries = lodChain;
+
+			pMesh->Translate(instance.translation);
+			pMesh->RotateY(instance.yaw);
+			pMesh->Scale(instance.scale);
+			pMesh->UpdateTransforms();
+		}
+
+		for (const Light& light : description.lights)
+		{
+			if (light.type == LightType::Directional)
+				AddDirectionalLight(light.direction, light.intensity, light.color);
+			else
+				AddPointLight(light.origin, light.intensity, light.color);
+		}
+
+		m_TriangleBudget = description.triangleBudget;
+
+		if (description.shadowGridResolution > 0)
+			BuildShadowGrids(description.shadowGridResolution);
+
+		m_IsLoaded = true;
 	}
 }
@@ -1,10 +1,16 @@
 #pragma once
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "Arena.h"
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "LightTree.h"
+#include "AliasTable.h"
+#include "ShadowGrid.h"
+#include "PagedMesh.h"
 
 namespace dae
 {
@@ -36,29 +42,110 @@ namespace dae
 		Camera& GetCamera() { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
 		bool DoesHit(const Ray& ray) const;
+		//Tests the cached occluder first, then stores whatever blocks the ray in it (or clears it)
+		bool DoesHit(const Ray& ray, ShadowOccluder& occluder) const;
+		//Shadow ray towards the light at lightIdx, settled by its shadow grid when it has one and the point isn't near an edge
+		bool IsLightOccluded(const Ray& ray, size_t lightIdx, ShadowOccluder& occluder) const;
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const std::vector<Material*>& GetMaterials() const { return m_Materials; }
+
+		//Bumped whenever geometry or lights change, the renderer restarts accumulation when it differs from the last frame's
+		uint64_t GetVersion() const { return m_Version; }
+
+		//Prints how much memory the scene's geometry arena holds
+		void PrintMemoryUsage() const;
+
+		//Rebuilds the light tree and alias table when lights were added or moved since the last frame
+		void UpdateLightSampling();
+		const LightTree& GetLightTree() const { return m_LightTree; }
+		//Point lights by power (intensity * luminance), other lights have weight zero
+		const AliasTable& GetLightAliasTable() const { return m_LightAliasTable; }
+
+		//Picks every mesh's LOD from its projected size, then coarsens the smallest meshes on screen until
+		//the triangle budget holds. Called by the renderer before each frame
+		void UpdateLODs();
+		//Triangles of the LODs picked for the current frame, meshes without LODs included
+		size_t GetSelectedTriangleCount() const { return m_SelectedTriangles; }
 
 	protected:
 		std::string	sceneName;
 
+		//Mesh buffers and BVHs, declared first so it outlives the meshes using it
+		Arena m_GeometryArena{};
+		//One per mesh level loaded in parallel by Scene_File, the scene arena isn't thread safe
+		std::vector<std::unique_ptr<Arena>> m_LoadArenas{};
+
 		std::vector<Plane> m_PlaneGeometries{};
 		std::vector<Sphere> m_SphereGeometries{};
 		//temp
 		//std::vector<Triangle> m_Triangles{};
 		//temp end
+		//Dense so hit tests stream over it, meshes are reached from outside through MeshHandles only
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
 		std::vector<Light> m_Lights{};
 		std::vector<Material*> m_Materials{};
 
 		Camera m_Camera{};
 
+		//One per light, only directional lights get one and only after BuildShadowGrids
+		std::vector<std::unique_ptr<ShadowGrid>> m_ShadowGrids{};
+
+		LightTree m_LightTree{};
+		AliasTable m_LightAliasTable{};
+		bool m_AreLightsDirty{ true };
+		uint64_t m_Version{};
+
+		//Zero for no limit. A budget below what the coarsest LODs need can't be met and is exceeded
+		size_t m_TriangleBudget{};
+		//Fraction of the view height a mesh's bounding sphere diameter has to cover for its most detailed
+		//LOD, below it the triangle count aimed for falls with the projected area
+		float m_LODFullDetailSize{ 0.25f };
+		size_t m_SelectedTriangles{};
+		//Projected size and mesh index of every mesh with LODs, kept to avoid allocating each frame
+		std::vector<std::pair<float, size_t>> m_LODCandidates{};
+
+		struct MeshSlot
+		{
+			unsigned int denseIdx{};
+			unsigned int generation{};
+		};
+
+		//Handles index the slots, slots index the dense meshes. Freed slots bump their generation and are reused
+		std::vector<MeshSlot> m_MeshSlots{};
+		std::vector<unsigned int> m_MeshDenseToSlot{};
+		std::vector<unsigned int> m_FreeMeshSlots{};
+
+		MeshHandle EmplaceTriangleMesh(TriangleMesh&& mesh);
+
+		//Call after moving or changing lights in Update so the light sampling structures get rebuilt
+		void MarkLightsChanged() { m_AreLightsDirty = true; ++m_Version; }
+		//Call after moving or changing meshes, planes or spheres in Update
+		void MarkGeometryChanged() { ++m_Version; }
+
+		bool DoesHitOccluder(const Ray& ray, const ShadowOccluder& occluder) const;
+		bool DoesHitPlane(const Ray& ray) const;
+		//Closest hit of everything but the infinite planes
+		void GetClosestObjectHit(const Ray& ray, HitRecord& hitRecord) const;
+
+		//Ray traces an occlusion grid for every directional light. Call at the end of Initialize, in scenes
+		//whose geometry and lights don't change afterwards: the grids are never updated. Grids hold each
+		//mesh's most detailed LOD, a coarser LOD picked later still casts the LOD0 shadow wherever the grid
+		//answers and its own shadow where a shadow ray has to decide
+		void BuildShadowGrids(int resolution = 512);
+
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
-		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		//Geometry allocated in the scene's arena, fill it and call Build before adding it
+		std::shared_ptr<MeshGeometry> CreateMeshGeometry();
+		MeshHandle AddTriangleMesh(std::shared_ptr<const MeshGeometry> pGeometry, TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		//Out-of-core geometry from PagedMeshGeometry::Open, traced through its page cache
+		MeshHandle AddTriangleMesh(std::shared_ptr<const PagedMeshGeometry> pGeometry, TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		void RemoveTriangleMesh(MeshHandle handle);
+		//Nullptr for a removed mesh. Don't keep the pointer, adding or removing a mesh can move it
+		TriangleMesh* GetTriangleMesh(MeshHandle handle);
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
@@ -130,7 +217,7 @@ namespace dae
 		void Initialize() override;
 		void Update(Timer* pTimer) override;
 	private:
-		TriangleMesh* pMesh{nullptr};
+		MeshHandle m_Mesh{};
 	};
 
 
@@ -150,7 +237,7 @@ namespace dae
 		void Initialize() override;
 		void Update(Timer* pTimer) override;
 	private:
-		TriangleMesh* m_pMeshes[3]{nullptr, nullptr, nullptr };
+		MeshHandle m_Meshes[3]{};
 	};
 
 
@@ -171,6 +258,28 @@ namespace dae
 		void Update(Timer* pTimer) override;
 
 	private:
-		TriangleMesh* pMesh{ nullptr };
+		MeshHandle m_Mesh{};
+	};
+
+	//+++++++++++++++++++++++++++++++++++++++++
+	//Scene read from a .scene text file or its compiled .sceneb form, see SceneFile.h
+	class Scene_File final : public Scene
+	{
+	public:
+		explicit Scene_File(const std::string& filename) : m_Filename{ filename } {}
+		~Scene_File() override = default;
+
+		Scene_File(const Scene_File&) = delete;
+		Scene_File(Scene_File&&) noexcept = delete;
+		Scene_File& operator=(const Scene_File&) = delete;
+		Scene_File& operator=(Scene_File&&) noexcept = delete;
+
+		//Leaves the scene empty when the file can't be read
+		void Initialize() override;
+		bool IsLoaded() const { return m_IsLoaded; }
+
+	private:
+		std::string m_Filename;
+		bool m_IsLoaded{};
 	};
 }
@@ -0,0 +1,674 @@
+#include "SceneFile.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+
+using namespace dae;
+
+//Text format, one statement per line, # starts a comment. Materials and meshes are referenced by name,
+//names and paths can't contain spaces. Mesh paths are relative to the working directory. A mesh's lod
+//statements add its simplified levels, most detailed first.
+//	camera <x y z> <fov>
+//	material <name> solid <r g b>
+//	material <name> lambert <r g b> <reflectance>
+//	material <name> lambertphong <r g b> <kd> <ks> <exponent>
+//	material <name> cooktorrence <r g b> <metalness> <roughness>
+//	plane <origin x y z> <normal x y z> <material>
+//	sphere <origin x y z> <radius> <material>
+//	mesh <name> <obj path> [compress | quantize]
+//	pagedmesh <name> <pmesh path> <resident budget MiB>
+//	lod <mesh> <obj path>
+//	instance <mesh> <back | front | none> <material> [translate x y z] [rotatey radians] [scale x y z]
+//	pointlight <origin x y z> <intensity> <r g b>
+//	directionallight <direction x y z> <intensity> <r g b>
+//	shadowgrids <resolution>
+//	trianglebudget <triangles>
+
+namespace
+{
+	constexpr char g_BinaryMagic[8]{ 'D', 'A', 'E', 'S', 'C', 'N', 'B', '\0' };
+	constexpr uint32_t g_BinaryVersion{ 3 };
+
+	//Materials are stored as unsigned char and the scene's default material takes the first one
+	constexpr size_t g_MaxMaterials{ 255 };
+
+	bool ReadVector(std::istream& stream, Vector3& v)
+	{
+		return static_cast<bool>(stream >> v.x >> v.y >> v.z);
+	}
+
+	bool ReadColor(std::istream& stream, ColorRGB& color)
+	{
+		return static_cast<bool>(stream >> color.r >> color.g >> color.b);
+	}
+
+	bool ReadCullMode(const std::string& name, TriangleCullMode& cullMode)
+	{
+		if (name == "back")
+			cullMode = TriangleCullMode::BackFaceCulling;
+		else if (name == "front")
+			cullMode = TriangleCullMode::FrontFaceCulling;
+		else if (name == "none")
+			cullMode = TriangleCullMode::NoCulling;
+		else
+			return false;
+
+		return true;
+	}
+
+	//A zero component can't be inverted, rays would be traced against a mesh of infinite size. NaN fails too
+	bool IsScaleValid(const Vector3& scale)
+	{
+		return std::abs(scale.x) > 0.f && std::abs(scale.y) > 0.f && std::abs(scale.z) > 0.f;
+	}
+
+	//Indices coming from either format are checked once, before anything uses them
+	bool Validate(const std::string& filename, const SceneDescription& description)
+	{
+		const size_t numMaterials{ description.materials.size() };
+		if (numMaterials > g_MaxMaterials - 1)
+		{
+			std::cout << filename << ": more than " << g_MaxMaterials - 1 << " materials" << std::endl;
+			return false;
+		}
+
+		//Enums read from a binary file can hold anything
+		for (const SceneDescription::MaterialDesc& material : description.materials)
+		{
+			if (material.type > SceneDescription::MaterialDesc::Type::CookTorrence)
+			{
+				std::cout << filename << ": unknown material type " << static_cast<int>(material.type) << std::endl;
+				return false;
+			}
+		}
+
+		for (const Light& light : description.lights)
+		{
+			if (light.type != LightType::Point && light.type != LightType::Directional)
+			{
+				std::cout << filename << ": unknown light type " << static_cast<int>(light.type) << std::endl;
+				return false;
+			}
+		}
+
+		for (const Plane& plane : description.planes)
+		{
+			if (plane.materialIndex >= numMaterials)
+			{
+				std::cout << filename << ": plane with unknown material " << static_cast<int>(plane.materialIndex) << std::endl;
+				return false;
+			}
+		}
+
+		for (const Sphere& sphere : description.spheres)
+		{
+			if (sphere.materialIndex >= numMaterials)
+			{
+				std::cout << filename << ": sphere with unknown material " << static_cast<int>(sphere.materialIndex) << std::endl;
+				return false;
+			}
+		}
+
+		for (const SceneDescription::MeshDesc& mesh : description.meshes)
+		{
+			if (mesh.residentBudgetMiB > 0 && !mesh.lodPaths.empty())
+			{
+				std::cout << filename << ": paged mesh " << mesh.path << " with LODs" << std::endl;
+				return false;
+			}
+		}
+
+		for (const SceneDescription::InstanceDesc& instance : description.instances)
+		{
+			if (instance.meshIdx >= description.meshes.size() || instance.materialIndex >= numMaterials ||
+				instance.cullMode > TriangleCullMode::NoCulling)
+			{
+				std::cout << filename << ": instance with unknown mesh, material or cull mode" << std::endl;
+				return false;
+			}
+
+			if (!IsScaleValid(instance.scale))
+			{
+				std::cout << filename << ": instance scaled to zero" << std::endl;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	class BinaryWriter final
+	{
+	public:
+		explicit BinaryWriter(std::ofstream& file) : m_File{ file } {}
+
+		template<typename T>
+		void Write(const T& value)
+		{
+			static_assert(std::is_arithmetic_v<T>, "Only numbers are written as they are in memory");
+			m_File.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		void Write(const Vector3& v)
+		{
+			Write(v.x);
+			Write(v.y);
+			Write(v.z);
+		}
+
+		void Write(const ColorRGB& color)
+		{
+			Write(color.r);
+			Write(color.g);
+			Write(color.b);
+		}
+
+		void Write(const std::string& text)
+		{
+			Write(static_cast<uint32_t>(text.size()));
+			m_File.write(text.data(), text.size());
+		}
+
+	private:
+		std::ofstream& m_File;
+	};
+
+	//Reads fail quietly once the stream has, check IsGood at the end of a section
+	class BinaryReader final
+	{
+	public:
+		explicit BinaryReader(std::ifstream& file) : m_File{ file } {}
+
+		bool IsGood() const { return static_cast<bool>(m_File); }
+
+		template<typename T>
+		T Read()
+		{
+			static_assert(std::is_arithmetic_v<T>, "Only numbers are read as they are in memory");
+			T value{};
+			m_File.read(reinterpret_cast<char*>(&value), sizeof(T));
+			return value;
+		}
+
+		Vector3 ReadVector()
+		{
+			Vector3 v{};
+			v.x = Read<float>();
+			v.y = Read<float>();
+			v.z = Read<float>();
+			return v;
+		}
+
+		ColorRGB ReadColor()
+		{
+			ColorRGB color{};
+			color.r = Read<float>();
+			color.g = Read<float>();
+			color.b = Read<float>();
+			return color;
+		}
+
+		std::string ReadString()
+		{
+			const uint32_t length{ Read<uint32_t>() };
+			//Anything longer is a corrupt length, not a path
+			if (!IsGood() || length > 4096)
+			{
+				m_File.setstate(std::ios::failbit);
+				return {};
+			}
+
+			std::string text(length, '\0');
+			m_File.read(text.data(), length);
+			return text;
+		}
+
+	private:
+		std::ifstream& m_File;
+	};
+}
+
+bool SceneFile::ReadText(const std::string& filename, SceneDescription& description)
+{
+	std::ifstream file{ filename };
+	if (!file)
+	{
+		std::cout << "Couldn't open " << filename << std::endl;
+		return false;
+	}
+
+	description = SceneDescription{};
+
+	std::unordered_map<std::string, unsigned char> materialIndices{};
+	std::unordered_map<std::string, uint32_t> meshIndices{};
+
+	int lineNumber{};
+	std::string line{};
+	while (std::getline(file, line))
+	{
+		++lineNumber;
+
+		const size_t commentPos{ line.find('#') };
+		if (commentPos != std::string::npos)
+			line.resize(commentPos);
+
+		std::istringstream stream{ line };
+		std::string command{};
+		if (!(stream >> command))
+			continue;
+
+		bool isValid{ true };
+		if (command == "camera")
+		{
+			isValid = ReadVector(stream, description.cameraOrigin) && static_cast<bool>(stream >> description.cameraFov);
+		}
+		else if (command == "material")
+		{
+			std::string name{};
+			std::string type{};
+			SceneDescription::MaterialDesc material{};
+			isValid = static_cast<bool>(stream >> name >> type) && ReadColor(stream, material.color);
+
+			int numParams{};
+			if (type == "solid")
+			{
+				material.type = SceneDescription::MaterialDesc::Type::SolidColor;
+			}
+			else if (type == "lambert")
+			{
+				material.type = SceneDescription::MaterialDesc::Type::Lambert;
+				numParams = 1;
+			}
+			else if (type == "lambertphong")
+			{
+				material.type = SceneDescription::MaterialDesc::Type::LambertPhong;
+				numParams = 3;
+			}
+			else if (type == "cooktorrence")
+			{
+				material.type = SceneDescription::MaterialDesc::Type::CookTorrence;
+				numParams = 2;
+			}
+			else
+			{
+				isValid = false;
+			}
+
+			for (int i{}; isValid && i < numParams; ++i)
+			{
+				isValid = static_cast<bool>(stream >> material.params[i]);
+			}
+
+			if (isValid)
+			{
+				materialIndices[name] = static_cast<unsigned char>(description.materials.size());
+				description.materials.push_back(material);
+			}
+		}
+		else if (command == "plane" || command == "sphere")
+		{
+			std::string materialName{};
+			if (command == "plane")
+			{
+				Plane plane{};
+				isValid = ReadVector(stream, plane.origin) && ReadVector(stream, plane.normal) && static_cast<bool>(stream >> materialName);
+				plane.normal.Normalize();
+				description.planes.push_back(plane);
+			}
+			else
+			{
+				Sphere sphere{};
+				isValid = ReadVector(stream, sphere.origin) && static_cast<bool>(stream >> sphere.radius >> materialName);
+				description.spheres.push_back(sphere);
+			}
+
+			const auto it{ materialIndices.find(materialName) };
+			if (!isValid || it == materialIndices.end())
+			{
+				std::cout << filename << "(" << lineNumber << "): unknown material '" << materialName << "'" << std::endl;
+				return false;
+			}
+
+			if (command == "plane")
+				description.planes.back().materialIndex = it->second;
+			else
+				description.spheres.back().materialIndex = it->second;
+		}
+		else if (command == "mesh")
+		{
+			std::string name{};
+			SceneDescription::MeshDesc mesh{};
+			isValid = static_cast<bool>(stream >> name >> mesh.path);
+
+			std::string option{};
+			while (isValid && stream >> option)
+			{
+				if (option == "compress")
+				{
+					mesh.compress = true;
+				}
+				else if (option == "quantize")
+				{
+					mesh.compress = true;
+					mesh.quantizePositions = true;
+				}
+				else
+				{
+					isValid = false;
+				}
+			}
+
+			if (isValid)
+			{
+				meshIndices[name] = static_cast<uint32_t>(description.meshes.size());
+				description.meshes.push_back(std::move(mesh));
+			}
+		}
+		else if (command == "pagedmesh")
+		{
+			std::string name{};
+			SceneDescription::MeshDesc mesh{};
+			isValid = static_cast<bool>(stream >> name >> mesh.path >> mesh.residentBudgetMiB) && mesh.residentBudgetMiB > 0;
+
+			if (isValid)
+			{
+				meshIndices[name] = static_cast<uint32_t>(description.meshes.size());
+				description.meshes.push_back(std::move(mesh));
+			}
+		}
+		else if (command == "lod")
+		{
+			std::string meshName{};
+			std::string path{};
+			isValid = static_cast<bool>(stream >> meshName >> path);
+
+			const auto meshIt{ meshIndices.find(meshName) };
+			if (isValid && (meshIt == meshIndices.end() || description.meshes[meshIt->second].residentBudgetMiB > 0))
+			{
+				std::cout << filename << "(" << lineNumber << "): unknown or paged mesh '" << meshName << "'" << std::endl;
+				return false;
+			}
+
+			if (isValid)
+				description.meshes[meshIt->second].lodPaths.push_back(std::move(path));
+		}
+		else if (command == "instance")
+		{
+			std::string meshName{};
+			std::string cullName{};
+			std::string materialName{};
+			SceneDescription::InstanceDesc instance{};
+			isValid = static_cast<bool>(stream >> meshName >> cullName >> materialName) && ReadCullMode(cullName, instance.cullMode);
+
+			const auto meshIt{ meshIndices.find(meshName) };
+			const auto materialIt{ materialIndices.find(materialName) };
+			if (isValid && (meshIt == meshIndices.end() || materialIt == materialIndices.end()))
+			{
+				std::cout << filename << "(" << lineNumber << "): unknown mesh '" << meshName << "' or material '" << materialName << "'" << std::endl;
+				return false;
+			}
+
+			std::string transform{};
+			while (isValid && stream >> transform)
+			{
+				if (transform == "translate")
+					isValid = ReadVector(stream, instance.translation);
+				else if (transform == "rotatey")
+					isValid = static_cast<bool>(stream >> instance.yaw);
+				else if (transform == "scale")
+					isValid = ReadVector(stream, instance.scale);
+				else
+					isValid = false;
+			}
+
+			if (isValid && !IsScaleValid(instance.scale))
+			{
+				std::cout << filename << "(" << lineNumber << "): instance of '" << meshName << "' scaled to zero" << std::endl;
+				return false;
+			}
+
+			if (isValid)
+			{
+				instance.meshIdx = meshIt->second;
+				instance.materialIndex = materialIt->second;
+				description.instances.push_back(instance);
+			}
+		}
+		else if (command == "pointlight" || command == "directionallight")
+		{
+			Light light{};
+			light.type = command == "pointlight" ? LightType::Point : LightType::Directional;
+			isValid = ReadVector(stream, light.type == LightType::Point ? light.origin : light.direction) &&
+				static_cast<bool>(stream >> light.intensity) && ReadColor(stream, light.color);
+			description.lights.push_back(light);
+		}
+		else if (command == "shadowgrids")
+		{
+			isValid = static_cast<bool>(stream >> description.shadowGridResolution);
+		}
+		else if (command == "trianglebudget")
+		{
+			isValid = static_cast<bool>(stream >> description.triangleBudget);
+		}
+		else
+		{
+			std::cout << filename << "(" << lineNumber << "): unknown statement '" << command << "'" << std::endl;
+			return false;
+		}
+
+		if (!isValid)
+		{
+			std::cout << filename << "(" << lineNumber << "): malformed '" << command << "'" << std::endl;
+			return false;
+		}
+	}
+
+	return Validate(filename, description);
+}
+
+bool SceneFile::WriteBinary(const std::string& filename, const SceneDescription& description)
+{
+	std::ofstream file{ filename, std::ios::binary };
+	if (!file)
+	{
+		std::cout << "Couldn't write " << filename << std::endl;
+		return false;
+	}
+
+	file.write(g_BinaryMagic, sizeof(g_BinaryMagic));
+
+	BinaryWriter writer{ file };
+	writer.Write(g_BinaryVersion);
+
+	writer.Write(description.cameraOrigin);
+	writer.Write(description.cameraFov);
+
+	writer.Write(static_cast<uint32_t>(description.materials.size()));
+	for (const SceneDescription::MaterialDesc& material : description.materials)
+	{
+		writer.Write(static_cast<uint8_t>(material.type));
+		writer.Write(material.color);
+		for (float param : material.params)
+		{
+			writer.Write(param);
+		}
+	}
+
+	writer.Write(static_cast<uint32_t>(description.planes.size()));
+	for (const Plane& plane : description.planes)
+	{
+		writer.Write(plane.origin);
+		writer.Write(plane.normal);
+		writer.Write(plane.materialIndex);
+	}
+
+	writer.Write(static_cast<uint32_t>(description.spheres.size()));
+	for (const Sphere& sphere : description.spheres)
+	{
+		writer.Write(sphere.origin);
+		writer.Write(sphere.radius);
+		writer.Write(sphere.materialIndex);
+	}
+
+	writer.Write(static_cast<uint32_t>(description.meshes.size()));
+	for (const SceneDescription::MeshDesc& mesh : description.meshes)
+	{
+		writer.Write(mesh.path);
+		writer.Write(static_cast<uint8_t>((mesh.compress ? 1 : 0) | (mesh.quantizePositions ? 2 : 0)));
+		writer.Write(mesh.residentBudgetMiB);
+		writer.Write(static_cast<uint32_t>(mesh.lodPaths.size()));
+		for (const std::string& lodPath : mesh.lodPaths)
+			writer.Write(lodPath);
+	}
+
+	writer.Write(static_cast<uint32_t>(description.instances.size()));
+	for (const SceneDescription::InstanceDesc& instance : description.instances)
+	{
+		writer.Write(instance.meshIdx);
+		writer.Write(static_cast<uint8_t>(instance.cullMode));
+		writer.Write(instance.materialIndex);
+		writer.Write(instance.translation);
+		writer.Write(instance.yaw);
+		writer.Write(instance.scale);
+	}
+
+	writer.Write(static_cast<uint32_t>(description.lights.size()));
+	for (const Light& light : description.lights)
+	{
+		writer.Write(static_cast<uint8_t>(light.type));
+		writer.Write(light.origin);
+		writer.Write(light.direction);
+		writer.Write(light.color);
+		writer.Write(light.intensity);
+	}
+
+	writer.Write(static_cast<int32_t>(description.shadowGridResolution));
+	writer.Write(description.triangleBudget);
+
+	return static_cast<bool>(file);
+}
+
+bool SceneFile::ReadBinary(const std::string& filename, SceneDescription& description)
+{
+	std::ifstream file{ filename, std::ios::binary };
+	if (!file)
+	{
+		std::cout << "Couldn't open " << filename << std::endl;
+		return false;
+	}
+
+	char magic[sizeof(g_BinaryMagic)]{};
+	file.read(magic, sizeof(magic));
+
+	BinaryReader reader{ file };
+	if (std::memcmp(magic, g_BinaryMagic, sizeof(magic)) != 0 || reader.Read<uint32_t>() != g_BinaryVersion)
+	{
+		std::cout << filename << ": not a compiled scene of version " << g_BinaryVersion << std::endl;
+		return false;
+	}
+
+	description = SceneDescription{};
+
+	description.cameraOrigin = reader.ReadVector();
+	description.cameraFov = reader.Read<float>();
+
+	//Counts aren't trusted for reserving, a corrupt one only runs the stream dry
+	for (uint32_t i{ reader.Read<uint32_t>() }; reader.IsGood() && i > 0; --i)
+	{
+		SceneDescription::MaterialDesc& material{ description.materials.emplace_back() };
+		material.type = static_cast<SceneDescription::MaterialDesc::Type>(reader.Read<uint8_t>());
+		material.color = reader.ReadColor();
+		for (float& param : material.params)
+		{
+			param = reader.Read<float>();
+		}
+	}
+
+	for (uint32_t i{ reader.Read<uint32_t>() }; reader.IsGood() && i > 0; --i)
+	{
+		Plane& plane{ description.planes.emplace_back() };
+		plane.origin = reader.ReadVector();
+		plane.normal = reader.ReadVector();
+		plane.materialIndex = reader.Read<unsigned char>();
+	}
+
+	for (uint32_t i{ reader.Read<uint32_t>() }; reader.IsGood() && i > 0; --i)
+	{
+		Sphere& sphere{ description.spheres.emplace_back() };
+		sphere.origin = reader.ReadVector();
+		sphere.radius = reader.Read<float>();
+		sphere.materialIndex = reader.Read<unsigned char>();
+	}
+
+	for (uint32_t i{ reader.Read<uint32_t>() }; reader.IsGood() && i > 0; --i)
+	{
+		SceneDescription::MeshDesc& mesh{ description.meshes.emplace_back() };
+		mesh.path = reader.ReadString();
+		const uint8_t flags{ reader.Read<uint8_t>() };
+		mesh.compress = (flags & 1) != 0;
+		mesh.quantizePositions = (flags & 2) != 0;
+		mesh.residentBudgetMiB = reader.Read<uint32_t>();
+		for (uint32_t lodIdx{ reader.Read<uint32_t>() }; reader.IsGood() && lodIdx > 0; --lodIdx)
+			mesh.lodPaths.push_back(reader.ReadString());
+	}
+
+	for (uint32_t i{ reader.Read<uint32_t>() }; reader.IsGood() && i > 0; --i)
+	{
+		SceneDescription::InstanceDesc& instance{ description.instances.emplace_back() };
+		instance.meshIdx = reader.Read<uint32_t>();
+		instance.cullMode = static_cast<TriangleCullMode>(reader.Read<uint8_t>());
+		instance.materialIndex = reader.Read<unsigned char>();
+		instance.translation = reader.ReadVector();
+		instance.yaw = reader.Read<float>();
+		instance.scale = reader.ReadVector();
+	}
+
+	for (uint32_t i{ reader.Read<uint32_t>() }; reader.IsGood() && i > 0; --i)
+	{
+		Light& light{ description.lights.emplace_back() };
+		light.type = static_cast<LightType>(reader.Read<uint8_t>());
+		light.origin = reader.ReadVector();
+		light.direction = reader.ReadVector();
+		light.color = reader.ReadColor();
+		light.intensity = reader.Read<float>();
+	}
+
+	description.shadowGridResolution = reader.Read<int32_t>();
+	description.triangleBudget = reader.Read<uint32_t>();
+
+	if (!reader.IsGood())
+	{
+		std::cout << filename << ": truncated compiled scene" << std::endl;
+		return false;
+	}
+
+	return Validate(filename, description);
+}
+
+bool SceneFile::Load(const std::string& filename, SceneDescription& description)
+{
+	char magic[sizeof(g_BinaryMagic)]{};
+	std::ifstream{ filename, std::ios::binary }.read(magic, sizeof(magic));
+
+	if (std::memcmp(magic, g_BinaryMagic, sizeof(magic)) == 0)
+		return ReadBinary(filename, description);
+
+	return ReadText(filename, description);
+}
+
+int SceneFile::Compile(const std::string& textFilename, const std::string& binaryFilename)
+{
+	SceneDescription description{};
+	if (!ReadText(textFilename, description) || !WriteBinary(binaryFilename, description))
+		return 1;
+
+	std::cout << "Compiled " << textFilename << " to " << binaryFilename << ": " << description.materials.size() << " materials, "
+		<< description.planes.size() + description.spheres.size() << " primitives, " << description.meshes.size() << " meshes, "
+		<< description.instances.size() << " instances, " << description.lights.size() << " lights" << std::endl;
+	return 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Math.h"
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Everything a Scene subclass sets up in Initialize, as data. Plane, sphere and instance materials
+	//index the materials below, not the scene's: the scene's default material comes first when applied
+	struct SceneDescription
+	{
+		struct MaterialDesc
+		{
+			enum class Type : uint8_t
+			{
+				SolidColor,
+				Lambert,
+				LambertPhong,
+				CookTorrence
+			};
+
+			Type type{};
+			ColorRGB color{};
+			//Lambert: reflectance. LambertPhong: kd, ks, exponent. CookTorrence: metalness, roughness
+			float params[3]{};
+		};
+
+		struct MeshDesc
+		{
+			std::string path{};
+			bool compress{};
+			bool quantizePositions{};
+			//Nonzero for a paged mesh (.pmesh): the path isn't loaded but mapped, at most this much stays resident
+			uint32_t residentBudgetMiB{};
+			//Simplified versions from RayTracer --build-lods, most detailed first. Not for paged meshes
+			std::vector<std::string> lodPaths{};
+		};
+
+		struct InstanceDesc
+		{
+			uint32_t meshIdx{};
+			TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
+			unsigned char materialIndex{};
+
+			Vector3 translation{};
+			//Radians around Y, like TriangleMesh::RotateY
+			float yaw{};
+			Vector3 scale{ 1.f, 1.f, 1.f };
+		};
+
+		Vector3 cameraOrigin{};
+		float cameraFov{ 45.f };
+
+		std::vector<MaterialDesc> materials{};
+		std::vector<Plane> planes{};
+		std::vector<Sphere> spheres{};
+		std::vector<MeshDesc> meshes{};
+		std::vector<InstanceDesc> instances{};
+		std::vector<Light> lights{};
+
+		//Zero builds no shadow grids
+		int shadowGridResolution{};
+		//Triangles the selected mesh LODs may add up to, zero for no limit
+		uint32_t triangleBudget{};
+	};
+
+	//Scenes as files: text (.scene) for authoring, compiled binary (.sceneb) for loading without parsing.
+	//Readers print what's wrong, with the line for text files, and return false
+	namespace SceneFile
+	{
+		bool ReadText(const std::string& filename, SceneDescription& description);
+		bool ReadBinary(const std::string& filename, SceneDescription& description);
+		bool WriteBinary(const std::string& filename, const SceneDescription& description);
+
+		//Either format, the binary one is recognised by its header
+		bool Load(const std::string& filename, SceneDescription& description);
+
+		//Text to binary, for RayTracer --compile-scene. Returns the process exit code
+		int Compile(const std::string& textFilename, const std::string& binaryFilename);
+	}
+}
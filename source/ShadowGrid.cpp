@@ -0,0 +1,93 @@
+#include "ShadowGrid.h"
+
+#include <algorithm>
+
+#include "DataTypes.h"
+
+using namespace dae;
+
+ShadowGrid::ShadowGrid(const Vector3& directionToLight, const Vector3& minAABB, const Vector3& maxAABB, int resolution)
+	: m_DirectionToLight{ directionToLight.Normalized() }
+	, m_Resolution{ std::max(2, resolution) }
+{
+	//Any axis that isn't parallel to the light gives a basis
+	const Vector3 helper{ std::abs(m_DirectionToLight.y) < 0.99f ? Vector3::UnitY : Vector3::UnitX };
+	m_Right = Vector3::Cross(helper, m_DirectionToLight).Normalized();
+	m_Up = Vector3::Cross(m_DirectionToLight, m_Right);
+
+	//Project the corners of the bounds onto the grid plane
+	float maxRight{ -FLT_MAX };
+	float maxUp{ -FLT_MAX };
+	float maxHeight{ -FLT_MAX };
+	m_MinRight = FLT_MAX;
+	m_MinUp = FLT_MAX;
+
+	for (int cornerIdx{}; cornerIdx < 8; ++cornerIdx)
+	{
+		const Vector3 corner{
+			cornerIdx & 1 ? maxAABB.x : minAABB.x,
+			cornerIdx & 2 ? maxAABB.y : minAABB.y,
+			cornerIdx & 4 ? maxAABB.z : minAABB.z };
+
+		const float right{ Vector3::Dot(corner, m_Right) };
+		const float up{ Vector3::Dot(corner, m_Up) };
+		m_MinRight = std::min(m_MinRight, right);
+		m_MinUp = std::min(m_MinUp, up);
+		maxRight = std::max(maxRight, right);
+		maxUp = std::max(maxUp, up);
+		maxHeight = std::max(maxHeight, Vector3::Dot(corner, m_DirectionToLight));
+	}
+
+	//Square cells, the shorter side of the grid simply has some unused rows
+	m_CellSize = std::max(std::max(maxRight - m_MinRight, maxUp - m_MinUp), 1e-4f) / m_Resolution;
+	m_TopHeight = maxHeight + 1.f;
+	m_OccluderMargin = 2.f * m_CellSize;
+
+	m_Heights.resize(static_cast<size_t>(m_Resolution) * m_Resolution, -FLT_MAX);
+}
+
+Ray ShadowGrid::GetCellRay(int x, int y) const
+{
+	const Vector3 origin{ m_Right * (m_MinRight + (x + 0.5f) * m_CellSize) +
+		m_Up * (m_MinUp + (y + 0.5f) * m_CellSize) +
+		m_DirectionToLight * m_TopHeight };
+
+	return Ray{ origin, -m_DirectionToLight };
+}
+
+void ShadowGrid::SetCellHit(int x, int y, float t)
+{
+	m_Heights[x + y * m_Resolution] = t == FLT_MAX ? -FLT_MAX : m_TopHeight - t;
+}
+
+ShadowGrid::Visibility ShadowGrid::Lookup(const Vector3& point) const
+{
+	//Nothing finite lies above a point outside the grid or above all geometry
+	const float height{ Vector3::Dot(point, m_DirectionToLight) };
+	if (height >= m_TopHeight)
+		return Visibility::Lit;
+
+	const float gridX{ (Vector3::Dot(point, m_Right) - m_MinRight) / m_CellSize };
+	const float gridY{ (Vector3::Dot(point, m_Up) - m_MinUp) / m_CellSize };
+	if (gridX < 0.f || gridY < 0.f || gridX >= m_Resolution || gridY >= m_Resolution)
+		return Visibility::Lit;
+
+	//The four cell centers around the point
+	const int x{ std::clamp(static_cast<int>(gridX - 0.5f), 0, m_Resolution - 2) };
+	const int y{ std::clamp(static_cast<int>(gridY - 0.5f), 0, m_Resolution - 2) };
+
+	const float* pRow{ &m_Heights[x + y * m_Resolution] };
+	const float litThreshold{ height + m_HeightBias };
+	const int occludedCount{ (pRow[0] > litThreshold) + (pRow[1] > litThreshold) +
+		(pRow[m_Resolution] > litThreshold) + (pRow[m_Resolution + 1] > litThreshold) };
+	if (occludedCount == 0)
+		return Visibility::Lit;
+
+	const float occludedThreshold{ height + m_OccluderMargin };
+	const int clearedCount{ (pRow[0] > occludedThreshold) + (pRow[1] > occludedThreshold) +
+		(pRow[m_Resolution] > occludedThreshold) + (pRow[m_Resolution + 1] > occludedThreshold) };
+	if (clearedCount == 4)
+		return Visibility::Occluded;
+
+	return Visibility::Unknown;
+}
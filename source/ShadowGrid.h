@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	struct Ray;
+
+	//Ray traced shadow map for a directional light. The bounds of the scene's finite geometry are
+	//covered by a grid perpendicular to the light, every cell stores how far towards the light the
+	//first surface under its center lies. Infinite planes are not in the grid.
+	class ShadowGrid final
+	{
+	public:
+		enum class Visibility
+		{
+			Lit,
+			Occluded,
+			//Close to a shadow edge, a shadow ray has to decide
+			Unknown,
+		};
+
+		ShadowGrid(const Vector3& directionToLight, const Vector3& minAABB, const Vector3& maxAABB, int resolution);
+		~ShadowGrid() = default;
+
+		ShadowGrid(const ShadowGrid&) = delete;
+		ShadowGrid(ShadowGrid&&) noexcept = delete;
+		ShadowGrid& operator=(const ShadowGrid&) = delete;
+		ShadowGrid& operator=(ShadowGrid&&) noexcept = delete;
+
+		int GetResolution() const { return m_Resolution; }
+
+		//Ray through the center of a cell, starting above the bounds and travelling with the light
+		Ray GetCellRay(int x, int y) const;
+		//t of the first hit along the cell's ray, FLT_MAX when it hit nothing
+		void SetCellHit(int x, int y, float t);
+
+		//Lit or occluded when the four cells around the point agree, unknown otherwise. Occluded also needs
+		//every cell to clear the point by m_OccluderMargin, a receiver that rises within a cell (a concave
+		//corner, a slope) isn't taken for its own occluder. Occluders smaller than a cell can fall between
+		//cell centers and go unnoticed
+		Visibility Lookup(const Vector3& point) const;
+
+	private:
+		Vector3 m_DirectionToLight{};
+		Vector3 m_Right{};
+		Vector3 m_Up{};
+
+		float m_MinRight{};
+		float m_MinUp{};
+		float m_CellSize{};
+		//Height (along the direction to the light) the cell rays start from
+		float m_TopHeight{};
+		//A surface only shadows a point when it's at least this much higher
+		float m_HeightBias{ 0.001f };
+		//How much higher than the point all four cells must be to call it occluded, in proportion to
+		//the cell size since that's how far the cell centers are from the point
+		float m_OccluderMargin{};
+
+		int m_Resolution{};
+		std::vector<float> m_Heights{};
+	};
+}
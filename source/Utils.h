@@ -1,8 +1,11 @@
 #pragma once
 #include <cassert>
+#include <cmath>
 #include <fstream>
 #include "Math.h"
 #include "DataTypes.h"
+#include "PagedMesh.h"
+#include "RayStats.h"
 
 //#define MOLLERTRUMBORE
 
@@ -19,6 +22,8 @@ namespace dae
 		//SPHERE HIT-TESTS
 		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
+			RAY_STATS_INC(SphereTests);
+
 			const Vector3 originToSphere{ sphere.origin - ray.origin };
 			const float originToSphereDistanceSqr{ originToSphere.SqrMagnitude() };
 
@@ -29,7 +34,7 @@ namespace dae
 			if (oTSPerpDistanceSqr > radiusSqr)
 				return false;
 
-			const const float hitPointOnSphere{ sqrtf(radiusSqr - oTSPerpDistanceSqr) };
+			const float hitPointOnSphere{ sqrtf(radiusSqr - oTSPerpDistanceSqr) };
 
 			const float t = oTSProjectedOnDirection - hitPointOnSphere;
 
@@ -65,6 +70,7 @@ namespace dae
 		//PLANE HIT-TESTS
 		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
+			RAY_STATS_INC(PlaneTests);
 
 			//check if looking at plane
 			const float denom = Vector3::Dot(ray.direction, plane.normal);
@@ -107,6 +113,8 @@ namespace dae
 		//TRIANGLE HIT-TESTS
 		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
+			RAY_STATS_INC(TriangleTests);
+
 			TriangleCullMode mode{ triangle.cullMode };
 			switch (triangle.cullMode)
 			{
@@ -256,6 +264,8 @@ namespace dae
 
 		inline bool SlabTest_TriangleMesh(const Ray& ray, const Vector3& minAABB, const Vector3& maxAABB)
 		{
+			RAY_STATS_INC(SlabTests);
+
 			const float tx1 = (minAABB.x - ray.origin.x) * ray.inversedDirection.x;
 			const float tx2 = (maxAABB.x - ray.origin.x) * ray.inversedDirection.x;
 
@@ -277,19 +287,28 @@ namespace dae
 			return tmax > 0 && tmax >= tmin;
 		}
 
-#ifdef BVH
-		inline void IntersectBVH(const TriangleMesh& mesh, const Ray& ray, Triangle& sharedTriangle, HitRecord& hitRecord, bool& hasHit, HitRecord& curClosestHit, bool ignoreHitRecord, unsigned int bvhNodeIdx)
+		//The direction isn't renormalised, so t along the object-space ray is the same t along the world ray
+		inline Ray ToObjectSpace(const TriangleMesh& mesh, const Ray& ray)
 		{
+			return Ray{ mesh.inverseWorldTransform.TransformPoint(ray.origin), mesh.inverseWorldTransform.TransformVector(ray.direction), ray.min, ray.max };
+		}
 
-			BVHNode& node{ mesh.pBvhNodes[bvhNodeIdx] };
+		//Geometry is a MeshGeometry or a PagedMeshPage, anything with bvhNodes and FetchTriangle
+		template<typename Geometry>
+		inline void IntersectBVH(const Geometry& geometry, const Ray& ray, Triangle& sharedTriangle, HitRecord& hitRecord, bool& hasHit, HitRecord& curClosestHit, bool ignoreHitRecord, unsigned int bvhNodeIdx)
+		{
+
+			const BVHNode& node{ geometry.bvhNodes[bvhNodeIdx] };
 
 			if (!SlabTest_TriangleMesh(ray, node.minAABB, node.MaxAABB)) return;
 
+			RAY_STATS_INC(BVHNodesVisited);
+
 			// If the current node is not the end node, recursively search the two child nodes 
 			if (!node.IsLeaf())
 			{
-				IntersectBVH(mesh, ray, sharedTriangle, hitRecord, hasHit, curClosestHit, ignoreHitRecord, node.leftChild);
-				IntersectBVH(mesh, ray, sharedTriangle, hitRecord, hasHit, curClosestHit, ignoreHitRecord, node.leftChild + 1);
+				IntersectBVH(geometry, ray, sharedTriangle, hitRecord, hasHit, curClosestHit, ignoreHitRecord, node.leftChild);
+				IntersectBVH(geometry, ray, sharedTriangle, hitRecord, hasHit, curClosestHit, ignoreHitRecord, node.leftChild + 1);
 				return;
 			}
 
@@ -297,10 +316,7 @@ namespace dae
 			for (unsigned int triangleIdx{}; triangleIdx < node.indexCount; triangleIdx += 3)
 			{
 				// Set the position and normal of the current triangle to the triangle object
-				sharedTriangle.v0 = mesh.transformedPositions[mesh.indices[node.firstIndex + triangleIdx]];
-				sharedTriangle.v1 = mesh.transformedPositions[mesh.indices[node.firstIndex + triangleIdx + 1]];
-				sharedTriangle.v2 = mesh.transformedPositions[mesh.indices[node.firstIndex + triangleIdx + 2]];
-				sharedTriangle.normal = mesh.transformedNormals[(node.firstIndex + triangleIdx) / 3];
+				geometry.FetchTriangle(node.firstIndex + triangleIdx, sharedTriangle);
 
 				// If the ray doesn't a triangle in the mesh, continue to the next triangle
 				if (!HitTest_Triangle(sharedTriangle, ray, curClosestHit, ignoreHitRecord)) continue;
@@ -318,48 +334,86 @@ namespace dae
 				}
 			}
 		}
-#endif // BVH
 
+		//Walks the resident top tree and faults in every page the ray reaches, pages are held only while they're traversed
+		inline void IntersectPagedMesh(const PagedMeshGeometry& geometry, const Ray& ray, Triangle& sharedTriangle, HitRecord& hitRecord, bool& hasHit, HitRecord& curClosestHit, bool ignoreHitRecord, unsigned int topNodeIdx)
+		{
+			const PagedMeshNode& node{ geometry.GetTopNodes()[topNodeIdx] };
+
+			if (!SlabTest_TriangleMesh(ray, node.minAABB, node.MaxAABB)) return;
+
+			RAY_STATS_INC(BVHNodesVisited);
+
+			if (!node.IsPage())
+			{
+				IntersectPagedMesh(geometry, ray, sharedTriangle, hitRecord, hasHit, curClosestHit, ignoreHitRecord, node.leftChild);
+				if (hasHit && ignoreHitRecord) return;
+				IntersectPagedMesh(geometry, ray, sharedTriangle, hitRecord, hasHit, curClosestHit, ignoreHitRecord, node.rightChild);
+				return;
+			}
+
+			const std::shared_ptr<const PagedMeshPage> pPage{ geometry.AcquirePage(node.pageIdx) };
+			if (pPage && node.pageNodeIdx < pPage->numNodes)
+				IntersectBVH(*pPage, ray, sharedTriangle, hitRecord, hasHit, curClosestHit, ignoreHitRecord, node.pageNodeIdx);
+		}
 
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
-#ifdef BVH
-
-			HitRecord tempRecord{};
-			bool hasHit{};
-			Triangle tri{};
-			tri.cullMode = mesh.cullMode;
-			tri.materialIndex = mesh.materialIndex;
-			IntersectBVH(mesh, ray, tri, hitRecord, hasHit, tempRecord, ignoreHitRecord, 0);
-#else
-			if (!SlabTest_TriangleMesh(ray, mesh.transformedMinAABB, mesh.transformedMaxAABB))
+			if (!mesh.pGeometry && !mesh.pPagedGeometry)
 				return false;
 
+			const Ray objectRay{ ToObjectSpace(mesh, ray) };
+
+			//Collects the closest hit in object space, only hits closer than the incoming record are taken to world space
+			HitRecord objectRecord{};
+			objectRecord.t = hitRecord.t;
+
 			HitRecord tempRecord{};
 			bool hasHit{};
-
 			Triangle tri{};
 			tri.cullMode = mesh.cullMode;
 			tri.materialIndex = mesh.materialIndex;
-			for (size_t i{}; i + 2 < mesh.indices.size(); i += 3)
+
+			if (mesh.pPagedGeometry)
+			{
+				IntersectPagedMesh(*mesh.pPagedGeometry, objectRay, tri, objectRecord, hasHit, tempRecord, ignoreHitRecord, 0);
+			}
+			else
 			{
-				tri.v0 = mesh.transformedPositions[mesh.indices[i]];
-				tri.v1 = mesh.transformedPositions[mesh.indices[i + 1]];
-				tri.v2 = mesh.transformedPositions[mesh.indices[i + 2]];
-				tri.normal = mesh.transformedNormals[i / 3];
+				const MeshGeometry& geometry{ *mesh.pGeometry };
+#ifdef BVH
+				if (geometry.bvhNodes.empty())
+					return false;
 
-				if (HitTest_Triangle(tri, ray, tempRecord, ignoreHitRecord))
+				IntersectBVH(geometry, objectRay, tri, objectRecord, hasHit, tempRecord, ignoreHitRecord, 0);
+#else
+				if (!SlabTest_TriangleMesh(ray, mesh.transformedMinAABB, mesh.transformedMaxAABB))
+					return false;
+
+				for (size_t i{}; i + 2 < geometry.GetIndexCount(); i += 3)
 				{
-					if (ignoreHitRecord) return true;
+					geometry.FetchTriangle(i, tri);
 
-					if (hitRecord.t > tempRecord.t)
+					if (HitTest_Triangle(tri, objectRay, tempRecord, ignoreHitRecord))
 					{
-						hitRecord = tempRecord;
+						if (ignoreHitRecord) return true;
+
+						if (objectRecord.t > tempRecord.t)
+						{
+							objectRecord = tempRecord;
+						}
+						hasHit = true;
 					}
-					hasHit = true;
 				}
-			}
 #endif // BVH
+			}
+
+			if (!ignoreHitRecord && objectRecord.didHit)
+			{
+				hitRecord = objectRecord;
+				hitRecord.origin = ray.origin + ray.direction * objectRecord.t;
+				hitRecord.normal = mesh.normalTransform.TransformVector(objectRecord.normal).Normalized();
+			}
 			return hasHit;
 		}
 
@@ -368,6 +422,131 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_TriangleMesh(mesh, ray, temp, true);
 		}
+
+		//Tests a single triangle of the mesh, triangleIdx counts triangles not indices.
+		//A paged triangle whose page isn't resident counts as a miss rather than a page fault
+		inline bool HitTest_MeshTriangle(const TriangleMesh& mesh, unsigned int triangleIdx, const Ray& ray)
+		{
+			Triangle tri{};
+			tri.cullMode = mesh.cullMode;
+			tri.materialIndex = mesh.materialIndex;
+
+			if (mesh.pPagedGeometry)
+			{
+				const PagedMeshGeometry& geometry{ *mesh.pPagedGeometry };
+				const unsigned int pageTriangleIdx{ triangleIdx % geometry.GetMaxTrianglesPerPage() };
+
+				const std::shared_ptr<const PagedMeshPage> pPage{ geometry.FindResidentPage(triangleIdx / geometry.GetMaxTrianglesPerPage()) };
+				if (!pPage || pageTriangleIdx >= pPage->numTriangles)
+					return false;
+
+				pPage->FetchTriangle(static_cast<size_t>(pageTriangleIdx) * 3, tri);
+			}
+			else
+			{
+				if (!mesh.pGeometry)
+					return false;
+
+				const MeshGeometry& geometry{ *mesh.pGeometry };
+				const size_t firstIndex{ static_cast<size_t>(triangleIdx) * 3 };
+				if (firstIndex + 2 >= geometry.GetIndexCount())
+					return false;
+
+				geometry.FetchTriangle(firstIndex, tri);
+			}
+
+			return HitTest_Triangle(tri, ToObjectSpace(mesh, ray));
+		}
+
+		//Any-hit traversal, stops at the first triangle found anywhere in the tree
+		template<typename Geometry>
+		inline bool FindOccluderBVH(const Geometry& geometry, const Ray& ray, Triangle& sharedTriangle, unsigned int bvhNodeIdx, unsigned int& occluderTriangleIdx)
+		{
+			const BVHNode& node{ geometry.bvhNodes[bvhNodeIdx] };
+
+			if (!SlabTest_TriangleMesh(ray, node.minAABB, node.MaxAABB)) return false;
+
+			RAY_STATS_INC(BVHNodesVisited);
+
+			if (!node.IsLeaf())
+			{
+				return FindOccluderBVH(geometry, ray, sharedTriangle, node.leftChild, occluderTriangleIdx) ||
+					FindOccluderBVH(geometry, ray, sharedTriangle, node.leftChild + 1, occluderTriangleIdx);
+			}
+
+			for (unsigned int triangleIdx{}; triangleIdx < node.indexCount; triangleIdx += 3)
+			{
+				geometry.FetchTriangle(node.firstIndex + triangleIdx, sharedTriangle);
+
+				if (HitTest_Triangle(sharedTriangle, ray))
+				{
+					occluderTriangleIdx = (node.firstIndex + triangleIdx) / 3;
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		//Occluder indices are pageIdx * GetMaxTrianglesPerPage() + the triangle within the page
+		inline bool FindOccluderPagedMesh(const PagedMeshGeometry& geometry, const Ray& ray, Triangle& sharedTriangle, unsigned int topNodeIdx, unsigned int& occluderTriangleIdx)
+		{
+			const PagedMeshNode& node{ geometry.GetTopNodes()[topNodeIdx] };
+
+			if (!SlabTest_TriangleMesh(ray, node.minAABB, node.MaxAABB)) return false;
+
+			RAY_STATS_INC(BVHNodesVisited);
+
+			if (!node.IsPage())
+			{
+				return FindOccluderPagedMesh(geometry, ray, sharedTriangle, node.leftChild, occluderTriangleIdx) ||
+					FindOccluderPagedMesh(geometry, ray, sharedTriangle, node.rightChild, occluderTriangleIdx);
+			}
+
+			const std::shared_ptr<const PagedMeshPage> pPage{ geometry.AcquirePage(node.pageIdx) };
+			if (!pPage || node.pageNodeIdx >= pPage->numNodes ||
+				!FindOccluderBVH(*pPage, ray, sharedTriangle, node.pageNodeIdx, occluderTriangleIdx))
+				return false;
+
+			occluderTriangleIdx += node.pageIdx * geometry.GetMaxTrianglesPerPage();
+			return true;
+		}
+
+		//Shadow test that also reports which triangle blocked the ray
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, unsigned int& occluderTriangleIdx)
+		{
+			if (!mesh.pGeometry && !mesh.pPagedGeometry)
+				return false;
+
+			const Ray objectRay{ ToObjectSpace(mesh, ray) };
+
+			Triangle tri{};
+			tri.cullMode = mesh.cullMode;
+			tri.materialIndex = mesh.materialIndex;
+
+			if (mesh.pPagedGeometry)
+				return FindOccluderPagedMesh(*mesh.pPagedGeometry, objectRay, tri, 0, occluderTriangleIdx);
+
+			const MeshGeometry& geometry{ *mesh.pGeometry };
+#ifdef BVH
+			return !geometry.bvhNodes.empty() && FindOccluderBVH(geometry, objectRay, tri, 0, occluderTriangleIdx);
+#else
+			if (!SlabTest_TriangleMesh(ray, mesh.transformedMinAABB, mesh.transformedMaxAABB))
+				return false;
+
+			for (size_t i{}; i + 2 < geometry.GetIndexCount(); i += 3)
+			{
+				geometry.FetchTriangle(i, tri);
+
+				if (HitTest_Triangle(tri, objectRay))
+				{
+					occluderTriangleIdx = static_cast<unsigned int>(i / 3);
+					return true;
+				}
+			}
+			return false;
+#endif // BVH
+		}
 #pragma endregion
 
 	}
@@ -382,6 +561,10 @@ namespace dae
 			case LightType::Point:
 				return Vector3{ light.origin - origin };
 				break;
+			case LightType::Directional:
+				//Unit length, a directional light has no distance
+				return -light.direction;
+				break;
 			default:
 				return{};
 			}
@@ -389,7 +572,14 @@ namespace dae
 
 		inline ColorRGB GetRadiance(const Light& light, const Vector3& target)
 		{
-			return light.color * (light.intensity / (light.origin - target).SqrMagnitude());
+			switch (light.type)
+			{
+			case LightType::Directional:
+				//No falloff, intensity is the irradiance on a surface facing the light
+				return light.color * light.intensity;
+			default:
+				return light.color * (light.intensity / (light.origin - target).SqrMagnitude());
+			}
 		}
 	}
 
@@ -409,7 +599,9 @@ namespace dae
 			while (!file.eof())
 			{
 				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
+				//Nothing left but whitespace, sCommand would still hold the last line's command
+				if (!(file >> sCommand))
+					break;
 				//use conditional statements to process the different commands	
 				if (sCommand == "#")
 				{
@@ -426,6 +618,9 @@ namespace dae
 				{
 					float i0, i1, i2;
 					file >> i0 >> i1 >> i2;
+					//Only plain "f i0 i1 i2" faces are read, anything else would stop the stream for good
+					if (!file)
+						return false;
 
 					indices.push_back((int)i0 - 1);
 					indices.push_back((int)i1 - 1);
@@ -438,31 +633,51 @@ namespace dae
 					break;
 			}
 
-			//Precompute normals
-			for (uint64_t index{}; index < indices.size(); index += 3)
+			//Faces may only point at vertices the file declared
+			for (const int index : indices)
 			{
-				uint32_t i0 = indices[index];
-				uint32_t i1 = indices[index + 1];
-				uint32_t i2 = indices[index + 2];
+				if (index < 0 || index >= static_cast<int>(positions.size()))
+					return false;
+			}
 
-				Vector3 edgeV0V1 = positions[i1] - positions[i0];
-				Vector3 edgeV0V2 = positions[i2] - positions[i0];
+			//Precompute normals, degenerate faces have none and are dropped
+			size_t keptIndexCount{};
+			for (size_t index{}; index + 2 < indices.size(); index += 3)
+			{
+				const int i0 = indices[index];
+				const int i1 = indices[index + 1];
+				const int i2 = indices[index + 2];
+
+				const Vector3 edgeV0V1 = positions[i1] - positions[i0];
+				const Vector3 edgeV0V2 = positions[i2] - positions[i0];
 				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
 
-				if (isnan(normal.x))
-				{
-					int k{};
-				}
-
-				normal.Normalize();
-				if (isnan(normal.x))
-				{
-					int k{};
-				}
+				//Also false for NaN, from positions that weren't numbers
+				if (!(normal.Normalize() > 0.f))
+					continue;
 
+				indices[keptIndexCount++] = i0;
+				indices[keptIndexCount++] = i1;
+				indices[keptIndexCount++] = i2;
 				normals.push_back(normal);
 			}
+			indices.resize(keptIndexCount);
+
+			return true;
+		}
+
+		//Parsed into regular vectors first, an arena never gets back what a growing vector left behind
+		static bool ParseOBJ(const std::string& filename, std::pmr::vector<Vector3>& positions, std::pmr::vector<Vector3>& normals, std::pmr::vector<int>& indices)
+		{
+			std::vector<Vector3> parsedPositions{};
+			std::vector<Vector3> parsedNormals{};
+			std::vector<int> parsedIndices{};
+			if (!ParseOBJ(filename, parsedPositions, parsedNormals, parsedIndices))
+				return false;
 
+			positions.assign(parsedPositions.begin(), parsedPositions.end());
+			normals.assign(parsedNormals.begin(), parsedNormals.end());
+			indices.assign(parsedIndices.begin(), parsedIndices.end());
 			return true;
 		}
 
@@ -6,11 +6,20 @@
 
 //Standard includes
 #include <iostream>
+#include <string>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
+#include "Profiler.h"
+#include "RayStats.h"
+#include "Benchmark.h"
+#include "KernelBenchmarks.h"
+#include "GoldenImages.h"
+#include "SceneFile.h"
+#include "PagedMesh.h"
+#include "MeshSimplifier.h"
 
 using namespace dae;
 
@@ -22,9 +31,46 @@ void ShutDown(SDL_Window* pWindow)
 
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	//RayTracer --compare <baseline.json> <current.json> [tolerance]: exits with 1 when anything regressed
+	if (argc >= 4 && std::string{ args[1] } == "--compare")
+	{
+		BenchmarkResult baseline{};
+		BenchmarkResult current{};
+		if (!Benchmark::LoadResult(args[2], baseline) || !Benchmark::LoadResult(args[3], current))
+		{
+			std::cout << "Couldn't read the benchmark results" << std::endl;
+			return 2;
+		}
+
+		const float tolerance{ argc >= 5 ? std::stof(args[4]) : 0.05f };
+		return Benchmark::CompareResults(baseline, current, tolerance) ? 1 : 0;
+	}
+
+	//RayTracer --kernels [filter]: micro-benchmarks the intersection kernels without opening a window
+	if (argc >= 2 && std::string{ args[1] } == "--kernels")
+		return RunKernelBenchmarks(argc >= 3 ? args[2] : "");
+
+	//RayTracer --golden [update]: checks every scene against its reference image and time budget, or records them
+	if (argc >= 2 && std::string{ args[1] } == "--golden")
+		return RunGoldenImageTests(argc >= 3 && std::string{ args[2] } == "update");
+
+	//RayTracer --compile-scene <scene> <compiled scene>: converts a text scene to the binary form
+	if (argc >= 4 && std::string{ args[1] } == "--compile-scene")
+		return SceneFile::Compile(args[2], args[3]);
+
+	//RayTracer --page-mesh <obj> <paged mesh> [page KiB]: splits a mesh into pages for a scene's pagedmesh statement
+	if (argc >= 4 && std::string{ args[1] } == "--page-mesh")
+		return PagedMeshGeometry::Convert(args[2], args[3], argc >= 5 ? static_cast<uint32_t>(std::stoi(args[4])) * 1024 : 1 << 16);
+
+	//RayTracer --build-lods <obj> [levels]: writes simplified versions of a mesh for a scene's lod statements
+	if (argc >= 3 && std::string{ args[1] } == "--build-lods")
+		return MeshSimplifier::BuildLODs(args[2], argc >= 4 ? std::stoi(args[3]) : 4);
+
+	//RayTracer --scene <file>: opens a .scene or compiled .sceneb file instead of the built-in scene
+	const std::string sceneFilename{ argc >= 3 && std::string{ args[1] } == "--scene" ? args[2] : "" };
+
+	//RayTracer --benchmark [frames] [warm-up frames]: benchmarks from the first frame, saves benchmark.json and quits
+	const bool isBenchmarkRun{ argc >= 2 && std::string{ args[1] } == "--benchmark" };
 
 #pragma region Testing Vector Products
 
@@ -76,13 +122,29 @@ int main(int argc, char* args[])
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
 
-	//const auto pScene = new Scene_W1();
-	//const auto pScene = new Scene_W2();
-	//const auto pScene = new Scene_W3();
-	//const auto pScene = new Scene_W4();
-	//const auto pScene = new Scene_W4_ReferneceScene();
-	const auto pScene = new Scene_W4_Bunny();
+	Scene* pScene{};
+	if (!sceneFilename.empty())
+		pScene = new Scene_File(sceneFilename);
+	else
+	{
+		//pScene = new Scene_W1();
+		//pScene = new Scene_W2();
+		//pScene = new Scene_W3();
+		//pScene = new Scene_W4();
+		//pScene = new Scene_W4_ReferneceScene();
+		pScene = new Scene_W4_Bunny();
+	}
 	pScene->Initialize();
+	pScene->PrintMemoryUsage();
+
+	//Benchmarks measure every frame being traced in full, a converged progressive image is only presented
+	Benchmark benchmark{};
+	bool wasProgressive{ pRenderer->IsProgressive() };
+	if (isBenchmarkRun)
+	{
+		pRenderer->SetProgressive(false);
+		benchmark.Start(argc >= 4 ? std::stoi(args[3]) : 30, argc >= 3 ? std::stoi(args[2]) : 200);
+	}
 
 	//Start loop
 	pTimer->Start();
@@ -91,6 +153,14 @@ int main(int argc, char* args[])
 	bool takeScreenshot = false;
 	while (isLooping)
 	{
+		//--------- Finish frame in flight ---------
+		//Scene and renderer state may only change once the previous trace is done
+		pRenderer->EndRender();
+		Profiler::Get().EndFrame();
+		const RayStatsFrame rayStats{ RayStats::Get().EndFrame(pRenderer->GetLastTraceTime()) };
+		//Read here, the next trace updates it on the workers
+		const float renderScale{ pRenderer->GetRenderScale() };
+
 		//--------- Get input events ---------
 		SDL_Event e;
 		while (SDL_PollEvent(&e))
@@ -112,8 +182,63 @@ int main(int argc, char* args[])
 				case SDL_SCANCODE_F3:
 					pRenderer->CycleLightingMode();
 					break;
+				case SDL_SCANCODE_F4:
+					pRenderer->ToggleProgressive();
+					break;
+				case SDL_SCANCODE_F5:
+					pRenderer->CycleInteractiveMode();
+					break;
 				case SDL_SCANCODE_F6:
-					pTimer->StartBenchmark();
+					if (!benchmark.IsRunning())
+					{
+						wasProgressive = pRenderer->IsProgressive();
+						pRenderer->SetProgressive(false);
+					}
+					benchmark.Start();
+					break;
+				case SDL_SCANCODE_F7:
+					pRenderer->ToggleAdaptiveSampling();
+					break;
+				case SDL_SCANCODE_F8:
+					if (!pRenderer->SaveCostMapToImage())
+						std::cout << "Cost map saved!" << std::endl;
+					else
+						std::cout << "No cost map saved, switch to the traversal cost view (F3) first" << std::endl;
+					break;
+				case SDL_SCANCODE_F9:
+					pRenderer->GetRenderTarget().CycleToneMapping();
+					break;
+				case SDL_SCANCODE_F10:
+					pRenderer->GetRenderTarget().ToggleSRGB();
+					break;
+				case SDL_SCANCODE_F11:
+					pRenderer->GetRenderTarget().ToggleDithering();
+					break;
+				case SDL_SCANCODE_O:
+					pRenderer->ToggleOccluderCache();
+					break;
+				case SDL_SCANCODE_L:
+					pRenderer->CycleLightSampling();
+					break;
+				case SDL_SCANCODE_KP_PLUS:
+					pRenderer->GetRenderTarget().SetExposure(pRenderer->GetRenderTarget().GetExposure() * 1.25f);
+					break;
+				case SDL_SCANCODE_KP_MINUS:
+					pRenderer->GetRenderTarget().SetExposure(pRenderer->GetRenderTarget().GetExposure() / 1.25f);
+					break;
+				case SDL_SCANCODE_F12:
+					if (!Profiler::Get().IsEnabled())
+					{
+						Profiler::Get().SetEnabled(true);
+						std::cout << "**PROFILER** capturing, press F12 again to stop" << std::endl;
+					}
+					else
+					{
+						Profiler::Get().SetEnabled(false);
+						Profiler::Get().PrintSummary();
+						if (Profiler::Get().ExportChromeTrace("profile.json"))
+							std::cout << "**PROFILER** trace saved to profile.json" << std::endl;
+					}
 					break;
 				}
 				break;
@@ -121,10 +246,15 @@ int main(int argc, char* args[])
 		}
 
 		//--------- Update ---------
-		pScene->Update(pTimer);
+		{
+			PROFILE_SCOPE(ProfileStage::SceneUpdate);
+			pScene->Update(pTimer);
+		}
 
 		//--------- Render ---------
-		pRenderer->Render(pScene);
+		//Trace the next frame on the workers while this thread presents the one that just finished
+		pRenderer->BeginRender(pScene);
+		pRenderer->Present();
 
 		//--------- Timer ---------
 		pTimer->Update();
@@ -132,7 +262,20 @@ int main(int argc, char* args[])
 		if (printTimer >= 1.f)
 		{
 			printTimer = 0.f;
-			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+			std::cout << "dFPS: " << pTimer->GetdFPS() << " (render scale: " << renderScale << ")" << std::endl;
+#ifdef RAY_STATS
+			RayStats::Get().PrintLastFrame();
+#endif // RAY_STATS
+		}
+
+		if (benchmark.AddFrame(pTimer->GetElapsed(), rayStats))
+		{
+			pRenderer->SetProgressive(wasProgressive);
+			if (benchmark.SaveResult("benchmark.json"))
+				std::cout << "Benchmark saved to benchmark.json" << std::endl;
+
+			if (isBenchmarkRun)
+				isLooping = false;
 		}
 
 		//Save screenshot after full render
@@ -145,6 +288,7 @@ int main(int argc, char* args[])
 			takeScreenshot = false;
 		}
 	}
+	pRenderer->EndRender();
 	pTimer->Stop();
 
 	//Shutdown "framework"